@@ -2,6 +2,167 @@
 # su is built here, and 
 LOCAL_PATH := $(call my-dir)
 
+# Client side of the daemon protocol, for native callers which want root
+# without spawning su
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libsuclient
+LOCAL_MODULE_TAGS := optional
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+LOCAL_SRC_FILES := client.c pts.c wire.c
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
+LOCAL_CFLAGS += -Werror -Wall
+
+include $(BUILD_STATIC_LIBRARY)
+
+# Measures keystroke echo latency through an interactive su session
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-bench-latency
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := bench/latency.c
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_MODULE_PATH := $(TARGET_OUT_OPTIONAL_EXECUTABLES)
+
+include $(BUILD_EXECUTABLE)
+
+# The same on the host, run it with -s and the su-host of a running daemon
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-bench-latency
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := bench/latency.c
+LOCAL_CFLAGS += -Werror -Wall -include $(LOCAL_PATH)/bench/host/host.h
+LOCAL_REQUIRED_MODULES := su-host
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# su built for the host, with stand-ins for liblog, libcutils, AppOps and
+# the package list, for su-bench-e2e to run
+SU_HOST_DAEMON_SOCKET_PATH := \"/tmp/su-bench-daemon/\"
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-host
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := su.c daemon.c utils.c batch.c session.c stats.c audit.c
+LOCAL_SRC_FILES += client.c pts.c wire.c bench/host/host.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/bench/host/include
+LOCAL_CFLAGS += -Werror -Wall -include $(LOCAL_PATH)/bench/host/host.h
+# glibc wants every write() checked, bionic does not
+LOCAL_CFLAGS += -Wno-unused-result
+LOCAL_CFLAGS += -DDAEMON_SOCKET_PATH=$(SU_HOST_DAEMON_SOCKET_PATH)
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Measures su -c true end to end on the host, with su-host
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-bench-e2e
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := bench/e2e.c stats.c bench/host/host.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/bench/host/include
+LOCAL_CFLAGS += -Werror -Wall -include $(LOCAL_PATH)/bench/host/host.h
+LOCAL_CFLAGS += -DDAEMON_SOCKET_PATH=$(SU_HOST_DAEMON_SOCKET_PATH)
+LOCAL_REQUIRED_MODULES := su-host
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Puts the daemon under concurrent load
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-loadgen
+LOCAL_MODULE_TAGS := optional
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SRC_FILES := bench/loadgen.c wire.c
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_MODULE_PATH := $(TARGET_OUT_OPTIONAL_EXECUTABLES)
+
+include $(BUILD_EXECUTABLE)
+
+# The same against su-host
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-loadgen
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := bench/loadgen.c wire.c bench/host/host.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/bench/host/include
+LOCAL_CFLAGS += -Werror -Wall -include $(LOCAL_PATH)/bench/host/host.h
+LOCAL_CFLAGS += -DDAEMON_SOCKET_PATH=$(SU_HOST_DAEMON_SOCKET_PATH)
+LOCAL_LDLIBS := -lpthread
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Measures the wire encoding and counts the syscalls it makes, which is
+# what the --wrap flags are for
+SU_BENCH_WIRE_LDFLAGS := -Wl,--wrap=read,--wrap=send,--wrap=sendmsg,--wrap=recvmsg,--wrap=fcntl
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-bench-wire
+LOCAL_MODULE_TAGS := optional
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SRC_FILES := bench/wire.c wire.c
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_LDFLAGS := $(SU_BENCH_WIRE_LDFLAGS)
+LOCAL_MODULE_PATH := $(TARGET_OUT_OPTIONAL_EXECUTABLES)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-bench-wire
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := bench/wire.c wire.c bench/host/host.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/bench/host/include
+LOCAL_CFLAGS += -Werror -Wall -include $(LOCAL_PATH)/bench/host/host.h
+LOCAL_LDFLAGS := $(SU_BENCH_WIRE_LDFLAGS)
+LOCAL_LDLIBS := -lpthread
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Measures the throughput and cost of the PTY relay
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-bench-relay
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := bench/relay.c pts.c
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_MODULE_PATH := $(TARGET_OUT_OPTIONAL_EXECUTABLES)
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-bench-relay
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := bench/relay.c pts.c
+LOCAL_CFLAGS += -Werror -Wall -include $(LOCAL_PATH)/bench/host/host.h
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Plays back sessions recorded with su --record
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-replay
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := replay.c
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_MODULE_PATH := $(TARGET_OUT_OPTIONAL_EXECUTABLES)
+
+include $(BUILD_EXECUTABLE)
+
+# Decodes the audit log of the su daemon
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := su-auditlog
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := auditlog.c
+LOCAL_CFLAGS += -Werror -Wall
+LOCAL_MODULE_PATH := $(TARGET_OUT_OPTIONAL_EXECUTABLES)
+
+include $(BUILD_EXECUTABLE)
+
 include $(CLEAR_VARS)
 
 LOCAL_MODULE := su
@@ -12,7 +173,9 @@ LOCAL_SHARED_LIBRARIES := \
     liblog \
     libutils \
 
-LOCAL_SRC_FILES := su.c daemon.c utils.c pts.c
+LOCAL_STATIC_LIBRARIES := libsuclient
+
+LOCAL_SRC_FILES := su.c daemon.c utils.c batch.c session.c stats.c audit.c
 LOCAL_SRC_FILES += binder/appops-wrapper.cpp binder/pm-wrapper.c
 LOCAL_CFLAGS += -Werror -Wall
 LOCAL_MODULE_PATH := $(TARGET_OUT_OPTIONAL_EXECUTABLES)
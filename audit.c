@@ -0,0 +1,101 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "audit.h"
+#include "su.h"
+
+static struct audit_ring* ring;
+
+static int ring_valid(const struct audit_ring* r) {
+    return r->magic == AUDIT_MAGIC && r->version == AUDIT_VERSION && r->size == AUDIT_RECORDS &&
+           r->record_size == sizeof(struct audit_record);
+}
+
+void audit_init(const char* path) {
+    struct stat st;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        PLOGE("open audit log");
+        return;
+    }
+    // A new file starts out zeroed, which is an empty ring
+    if (fstat(fd, &st) || (st.st_size != sizeof(*ring) && ftruncate(fd, sizeof(*ring)))) {
+        PLOGE("truncate audit log");
+        close(fd);
+        return;
+    }
+    struct audit_ring* r = mmap(NULL, sizeof(*r), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED) {
+        PLOGE("mmap audit log");
+        return;
+    }
+    // The records of earlier runs are kept, the sequence numbers go on
+    // from theirs. Anything but a ring of ours is started over.
+    if (!ring_valid(r)) {
+        __atomic_store_n(&r->magic, 0, __ATOMIC_RELAXED);
+        memset(r, 0, sizeof(*r));
+        r->size = AUDIT_RECORDS;
+        r->record_size = sizeof(struct audit_record);
+        r->version = AUDIT_VERSION;
+        // Written last, a decoder takes the ring as valid from here on
+        __atomic_store_n(&r->magic, AUDIT_MAGIC, __ATOMIC_RELEASE);
+    }
+    ring = r;
+}
+
+void audit_write(const struct audit_record* record) {
+    if (!ring) return;
+
+    uint64_t seq = __atomic_add_fetch(&ring->next, 1, __ATOMIC_RELAXED);
+    struct audit_record* slot = &ring->records[(seq - 1) & (AUDIT_RECORDS - 1)];
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->time = record->time;
+    slot->from_uid = record->from_uid;
+    slot->to_uid = record->to_uid;
+    slot->from_pid = record->from_pid;
+    slot->client_pid = record->client_pid;
+    slot->command_hash = record->command_hash;
+    slot->outcome = record->outcome;
+    slot->handshake_us = record->handshake_us;
+    slot->decision_us = record->decision_us;
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+}
+
+uint32_t audit_hash(int argc, char* const argv[]) {
+    uint32_t hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        // The NUL goes in too, so that "a b" and "ab" differ
+        const unsigned char* p = (const unsigned char*)argv[i];
+        do {
+            hash = (hash ^ *p) * 16777619u;
+        } while (*p++);
+    }
+    return hash;
+}
@@ -0,0 +1,88 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * audit.h
+ *
+ * The audit log of the daemon: a record of every decision, written as it
+ * is to a ring of fixed size records in a file which the daemon maps when
+ * it starts, and which survives restarts of the daemon. Nothing is
+ * formatted while serving a request, su-auditlog decodes the file
+ * afterwards.
+ *
+ * Writers claim a slot by bumping next, and publish the record by storing
+ * its sequence number last. A slot whose sequence number is 0, or changes
+ * while it is read, is being written.
+ */
+
+#ifndef _AUDIT_H_
+#define _AUDIT_H_
+
+#include <stdint.h>
+
+#include "su.h"
+
+#define AUDIT_PATH DAEMON_SOCKET_PATH "audit"
+
+#define AUDIT_MAGIC 0x41555553  // "SUAU"
+#define AUDIT_VERSION 1
+// Must be a power of two
+#define AUDIT_RECORDS 1024
+
+// What was decided, and why
+enum audit_outcome {
+    AUDIT_ALLOW_ROOT = 1,
+    AUDIT_ALLOW_SHELL,
+    AUDIT_ALLOW_APPOPS,
+    AUDIT_ALLOW_MASTER,
+    AUDIT_DENY_UNKNOWN_CALLER,
+    AUDIT_DENY_ACCESS_DISABLED,
+    AUDIT_DENY_APPOPS,
+};
+
+struct audit_record {
+    uint64_t seq;           // 1 for the first record of the ring, 0 while written
+    int64_t time;           // when the request was decided, ns since the epoch
+    uint32_t from_uid;      // the caller
+    uint32_t to_uid;        // the identity asked for
+    int32_t from_pid;       // the process asking for root
+    int32_t client_pid;     // the su client, the request id of traces
+    uint32_t command_hash;  // FNV-1a of the arguments, NUL separated
+    uint32_t outcome;       // enum audit_outcome
+    uint32_t handshake_us;  // from accepting the connection to acknowledging the request
+    uint32_t decision_us;   // from accepting the connection to the outcome
+};
+
+struct audit_ring {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;  // AUDIT_RECORDS
+    uint32_t record_size;
+    uint64_t next;  // how many records were ever claimed
+    struct audit_record records[AUDIT_RECORDS];
+};
+
+/*
+ * Maps the ring, creating it if there is none or it is not valid. Until
+ * then, audit_write() does nothing.
+ */
+void audit_init(const char* path);
+
+void audit_write(const struct audit_record* record);
+
+uint32_t audit_hash(int argc, char* const argv[]);
+
+#endif
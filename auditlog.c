@@ -0,0 +1,140 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * su-auditlog
+ *
+ * Decodes the audit log of the su daemon, oldest record first. It works
+ * on the live log as well as on a copy of it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audit.h"
+
+static const char* const outcomes[] = {
+    [AUDIT_ALLOW_ROOT] = "allow root",
+    [AUDIT_ALLOW_SHELL] = "allow shell",
+    [AUDIT_ALLOW_APPOPS] = "allow appops",
+    [AUDIT_ALLOW_MASTER] = "allow master",
+    [AUDIT_DENY_UNKNOWN_CALLER] = "deny unknown-caller",
+    [AUDIT_DENY_ACCESS_DISABLED] = "deny access-disabled",
+    [AUDIT_DENY_APPOPS] = "deny appops",
+};
+
+static void usage(int status) {
+    FILE* stream = (status == EXIT_SUCCESS) ? stdout : stderr;
+
+    fprintf(stream,
+            "Usage: su-auditlog [options] [FILE]\n\n"
+            "Decodes FILE, " AUDIT_PATH " by default.\n\n"
+            "Options:\n"
+            "  -h                  display this help message and exit\n"
+            "  -n COUNT            only show the latest COUNT records\n");
+    exit(status);
+}
+
+static void print_record(const struct audit_record* r) {
+    char when[32];
+    time_t secs = r->time / 1000000000LL;
+    struct tm tm;
+    const char* outcome = "unknown";
+
+    if (r->outcome < sizeof(outcomes) / sizeof(outcomes[0]) && outcomes[r->outcome]) {
+        outcome = outcomes[r->outcome];
+    }
+
+    strftime(when, sizeof(when), "%F %T", localtime_r(&secs, &tm));
+    printf("%llu %s.%03d %u->%u pid %d client %d cmd %08x %s handshake %uus decision %uus\n",
+           (unsigned long long)r->seq, when, (int)(r->time / 1000000 % 1000), r->from_uid,
+           r->to_uid, r->from_pid, r->client_pid, r->command_hash, outcome, r->handshake_us,
+           r->decision_us);
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = AUDIT_PATH;
+    uint64_t count = AUDIT_RECORDS;
+    struct stat st;
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:")) != -1) {
+        switch (c) {
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case 'n':
+                count = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                usage(2);
+        }
+    }
+    if (optind < argc - 1) usage(2);
+    if (optind == argc - 1) path = argv[optind];
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "Cannot read %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (st.st_size < (off_t)sizeof(struct audit_ring)) {
+        fprintf(stderr, "%s is not a su audit log\n", path);
+        return EXIT_FAILURE;
+    }
+    const struct audit_ring* ring = mmap(NULL, sizeof(*ring), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != AUDIT_MAGIC) {
+        fprintf(stderr, "%s is not a su audit log\n", path);
+        return EXIT_FAILURE;
+    }
+    if (ring->version != AUDIT_VERSION || ring->size != AUDIT_RECORDS ||
+        ring->record_size != sizeof(struct audit_record)) {
+        fprintf(stderr, "%s is a version %u audit log, only %d is supported\n", path,
+                ring->version, AUDIT_VERSION);
+        return EXIT_FAILURE;
+    }
+
+    // The daemon may be writing as we go, records it overwrites are skipped
+    uint64_t next = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+    if (count > AUDIT_RECORDS) count = AUDIT_RECORDS;
+    uint64_t seq = next > count ? next - count + 1 : 1;
+    for (; seq <= next; seq++) {
+        const struct audit_record* slot = &ring->records[(seq - 1) & (AUDIT_RECORDS - 1)];
+        struct audit_record record;
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq) continue;
+        memcpy(&record, slot, sizeof(record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) continue;
+        print_record(&record);
+    }
+
+    return EXIT_SUCCESS;
+}
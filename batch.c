@@ -0,0 +1,262 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * batch.c
+ *
+ * Runs a list of commands under a single authorized su request, with a
+ * bounded number of them in flight at once. Every line written back is
+ * tagged with the command's 1-based position in the list:
+ *
+ *   ID out TEXT     a line the command wrote to stdout
+ *   ID err TEXT     a line the command wrote to stderr
+ *   ID exit CODE    the command finished
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "su.h"
+
+#define BATCH_LINE_MAX 1024
+
+struct batch_stream {
+    int fd;
+    size_t len;
+    char buf[BATCH_LINE_MAX];
+};
+
+struct batch_job {
+    pid_t pid;
+    int id;
+    struct batch_stream out;
+    struct batch_stream err;
+};
+
+static void emit(int id, const char* tag, const char* text, size_t len) {
+    printf("%d %s %.*s\n", id, tag, (int)len, text);
+    fflush(stdout);
+}
+
+/*
+ * Emits every complete line in the stream buffer, or the whole buffer
+ * if it is full or the stream has ended.
+ */
+static void flush_stream(int id, const char* tag, struct batch_stream* s, int eof) {
+    char* start = s->buf;
+    char* nl;
+
+    while ((nl = memchr(start, '\n', s->len - (start - s->buf))) != NULL) {
+        emit(id, tag, start, nl - start);
+        start = nl + 1;
+    }
+    s->len -= start - s->buf;
+    memmove(s->buf, start, s->len);
+
+    if (s->len && (eof || s->len == sizeof(s->buf))) {
+        emit(id, tag, s->buf, s->len);
+        s->len = 0;
+    }
+}
+
+static void read_stream(int id, const char* tag, struct batch_stream* s) {
+    ssize_t len = read(s->fd, s->buf + s->len, sizeof(s->buf) - s->len);
+    if (len < 0 && errno == EINTR) return;
+    if (len <= 0) {
+        close(s->fd);
+        s->fd = -1;
+        flush_stream(id, tag, s, 1);
+        return;
+    }
+    s->len += len;
+    flush_stream(id, tag, s, 0);
+}
+
+static int start_job(const struct su_context* ctx, struct batch_job* job, int id,
+                     const char* shell, const char* command) {
+    int out[2], err[2];
+
+    if (pipe2(out, O_CLOEXEC)) return -1;
+    if (pipe2(err, O_CLOEXEC)) {
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+
+    IF_ALOGD() {
+        ALOGD("%u %s executing %u %s (batch %d)", ctx->from.uid, ctx->from.bin, ctx->to.uid,
+              command, id);
+    }
+
+    pid_t pid = fork();
+    if (!pid) {
+        int null = open("/dev/null", O_RDONLY);
+        if (null < 0 || dup2(null, STDIN_FILENO) < 0 || dup2(out[1], STDOUT_FILENO) < 0 ||
+            dup2(err[1], STDERR_FILENO) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        execl(shell, shell, "-c", command, (char*)NULL);
+        fprintf(stderr, "Cannot execute %s: %s\n", shell, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+
+    close(out[1]);
+    close(err[1]);
+    if (pid < 0) {
+        close(out[0]);
+        close(err[0]);
+        return -1;
+    }
+
+    job->pid = pid;
+    job->id = id;
+    job->out.fd = out[0];
+    job->out.len = 0;
+    job->err.fd = err[0];
+    job->err.len = 0;
+    return 0;
+}
+
+int run_batch(const struct su_context* ctx) {
+    const char* shell = ctx->to.shell ? ctx->to.shell : DEFAULT_SHELL;
+    int jobs = ctx->to.jobs;
+    int code = EXIT_SUCCESS;
+    int active = 0;
+    int next_id = 1;
+    char* line = NULL;
+    size_t line_size = 0;
+    FILE* list;
+    int i;
+
+    if (jobs <= 0) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        if (jobs <= 0) jobs = 1;
+    }
+
+    if (!strcmp(ctx->to.batch, "-")) {
+        list = stdin;
+    } else {
+        list = fopen(ctx->to.batch, "re");
+        if (!list) {
+            fprintf(stderr, "Cannot read %s: %s\n", ctx->to.batch, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct batch_job* slots = calloc(jobs, sizeof(struct batch_job));
+    struct pollfd* fds = calloc(jobs * 2, sizeof(struct pollfd));
+    if (!slots || !fds) {
+        ALOGE("unable to allocate %d batch slots", jobs);
+        return EXIT_FAILURE;
+    }
+
+    int more = 1;
+    int lingering = 0;
+    while (more || active) {
+        // Fill every free slot from the list
+        for (i = 0; more && i < jobs; i++) {
+            if (slots[i].pid) continue;
+
+            ssize_t len = getline(&line, &line_size, list);
+            if (len < 0) {
+                more = 0;
+                break;
+            }
+            if (len && line[len - 1] == '\n') line[--len] = '\0';
+            if (!len || line[0] == '#') {
+                i--;
+                continue;
+            }
+
+            int id = next_id++;
+            if (start_job(ctx, &slots[i], id, shell, line)) {
+                PLOGE("batch command %d", id);
+                printf("%d exit %d\n", id, EXIT_FAILURE);
+                fflush(stdout);
+                code = EXIT_FAILURE;
+                i--;
+                continue;
+            }
+            active++;
+        }
+
+        int nfds = 0;
+        for (i = 0; i < jobs; i++) {
+            if (!slots[i].pid) continue;
+            if (slots[i].out.fd >= 0) {
+                fds[nfds].fd = slots[i].out.fd;
+                fds[nfds++].events = POLLIN;
+            }
+            if (slots[i].err.fd >= 0) {
+                fds[nfds].fd = slots[i].err.fd;
+                fds[nfds++].events = POLLIN;
+            }
+        }
+
+        if (poll(fds, nfds, (nfds && !lingering) ? -1 : 50) < 0 && errno != EINTR) {
+            PLOGE("poll");
+            break;
+        }
+
+        lingering = 0;
+        for (i = 0; i < jobs; i++) {
+            struct batch_job* job = &slots[i];
+            int j;
+            if (!job->pid) continue;
+
+            for (j = 0; j < nfds; j++) {
+                if (!fds[j].revents) continue;
+                if (fds[j].fd == job->out.fd) read_stream(job->id, "out", &job->out);
+                if (fds[j].fd == job->err.fd) read_stream(job->id, "err", &job->err);
+            }
+
+            // A command is done once both of its streams are closed
+            if (job->out.fd >= 0 || job->err.fd >= 0) continue;
+
+            // It may have closed them early and still be running
+            int status, ret;
+            pid_t pid = waitpid(job->pid, &status, WNOHANG);
+            if (pid == 0) {
+                lingering++;
+                continue;
+            }
+            if (pid > 0) {
+                ret = WIFSIGNALED(status) ? WTERMSIG(status) + 128 : WEXITSTATUS(status);
+            } else {
+                ret = EXIT_FAILURE;
+            }
+            if (ret) code = EXIT_FAILURE;
+            printf("%d exit %d\n", job->id, ret);
+            fflush(stdout);
+
+            job->pid = 0;
+            active--;
+        }
+    }
+
+    free(line);
+    free(fds);
+    free(slots);
+    if (list != stdin) fclose(list);
+    return code;
+}
@@ -0,0 +1,340 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * su-bench-e2e
+ *
+ * Measures how long su -c true takes from start to finish on a Linux host,
+ * against a daemon of our own. su-host is su built for the host with the
+ * stand-ins under bench/host, and its daemon lives in DAEMON_SOCKET_PATH
+ * as that build defines it.
+ *
+ * Every caller class is measured with and without a terminal. This has to
+ * run as root, as the daemon does, which also lets us call su as the shell
+ * and as an app. Each case is printed on a line of its own, with nothing
+ * else which changes between runs, so results are easy to diff.
+ *
+ * The footprint of the idle daemon is given before and after, and with a
+ * budget, going over it fails the run.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <limits.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/android_filesystem_config.h>
+
+#include "stats.h"
+
+#ifndef DAEMON_SOCKET_PATH
+#error "DAEMON_SOCKET_PATH must match the one su-host was built with"
+#endif
+
+#define WARMUP 10
+// For the processes serving the last requests to be gone
+#define IDLE_MS 200
+
+struct bench_case {
+    const char* caller;
+    uid_t uid;
+    int pty;
+};
+
+static const struct bench_case cases[] = {
+    {"root", AID_ROOT, 0},   {"root", AID_ROOT, 1},
+    {"shell", AID_SHELL, 0}, {"shell", AID_SHELL, 1},
+    {"app", AID_APP, 0},     {"app", AID_APP, 1},
+};
+
+static void usage(int status) {
+    FILE* stream = (status == EXIT_SUCCESS) ? stdout : stderr;
+
+    fprintf(stream,
+            "Usage: su-bench-e2e [options]\n\n"
+            "Options:\n"
+            "  -b KIB              fail if the idle daemon ends up with an RSS over KIB KiB\n"
+            "  -h                  display this help message and exit\n"
+            "  -n COUNT            run COUNT requests per case, default 200\n"
+            "  -s SU               run SU, su-host next to us by default\n");
+    exit(status);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// The shell and app uids must be able to run su, wherever it was built
+static int copy_su(const char* from, const char* to) {
+    char buf[65536];
+    ssize_t len;
+
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return -1;
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    while ((len = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, len) != len) {
+            len = -1;
+            break;
+        }
+    }
+    close(in);
+    if (close(out) || len < 0) return -1;
+    return 0;
+}
+
+static void redirect_stdio(int fd) {
+    if (dup2(fd, STDIN_FILENO) < 0 || dup2(fd, STDOUT_FILENO) < 0 ||
+        dup2(fd, STDERR_FILENO) < 0) {
+        _exit(127);
+    }
+}
+
+static int daemon_up(void) {
+    struct sockaddr_un sun;
+
+    int fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return 0;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_LOCAL;
+    snprintf(sun.sun_path, sizeof(sun.sun_path), "%s/su-daemon", DAEMON_SOCKET_PATH);
+    int up = connect(fd, (struct sockaddr*)&sun, sizeof(sun)) == 0;
+    close(fd);
+    return up;
+}
+
+static pid_t start_daemon(const char* su) {
+    int i;
+
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (!pid) {
+        int null = open("/dev/null", O_RDWR);
+        if (null < 0 || setsid() < 0) _exit(127);
+        redirect_stdio(null);
+        execl(su, su, "--daemon", (char*)NULL);
+        _exit(127);
+    }
+
+    // Connecting before the daemon is up fails, so just keep trying
+    for (i = 0; i < 200; i++) {
+        if (daemon_up()) return pid;
+        if (waitpid(pid, NULL, WNOHANG) == pid) return -1;
+        usleep(10000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+// Runs su -c true as the case says, returns how long it took or -1
+static int64_t run_once(const char* su, const struct bench_case* c) {
+    int master = -1, status;
+    int64_t start = now_ns();
+
+    if (c->pty) {
+        master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (master < 0 || grantpt(master) || unlockpt(master)) return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        if (master >= 0) close(master);
+        return -1;
+    }
+    if (!pid) {
+        int fd;
+        if (c->pty) {
+            fd = open(ptsname(master), O_RDWR);
+            if (fd < 0 || setsid() < 0 || ioctl(fd, TIOCSCTTY, 0) < 0) _exit(127);
+        } else {
+            fd = open("/dev/null", O_RDWR);
+            if (fd < 0) _exit(127);
+        }
+        redirect_stdio(fd);
+        if (setgroups(0, NULL) || setgid(c->uid) || setuid(c->uid)) _exit(127);
+        execl(su, "su", "-c", "true", (char*)NULL);
+        _exit(127);
+    }
+
+    int ret = waitpid(pid, &status, 0);
+    int64_t elapsed = now_ns() - start;
+    if (master >= 0) close(master);
+    if (ret != pid || !WIFEXITED(status) || WEXITSTATUS(status)) return -1;
+    return elapsed;
+}
+
+static void idle_footprint(pid_t daemon, int64_t* rss_kb, int64_t* pss_kb) {
+    usleep(IDLE_MS * 1000);
+    if (stats_footprint(daemon, rss_kb, pss_kb)) *rss_kb = *pss_kb = -1;
+}
+
+static void run_case(const char* su, const struct bench_case* c, int count) {
+    int64_t* samples = malloc(sizeof(int64_t) * count);
+    int64_t total = 0;
+    int i, n = 0, failed = 0;
+
+    if (!samples) exit(EXIT_FAILURE);
+    for (i = 0; i < WARMUP; i++) {
+        run_once(su, c);
+    }
+    for (i = 0; i < count; i++) {
+        int64_t t = run_once(su, c);
+        if (t < 0) {
+            failed++;
+            continue;
+        }
+        samples[n++] = t;
+        total += t;
+    }
+
+    printf("%-5s %-7s", c->caller, c->pty ? "pty" : "no-pty");
+    if (n) {
+        qsort(samples, n, sizeof(int64_t), cmp_int64);
+#define PCT(p) (samples[(n - 1) * (p) / 100] / 1000.0)
+        printf(" mean %8.1f p50 %8.1f p90 %8.1f p99 %8.1f max %8.1f us", total / n / 1000.0,
+               PCT(50), PCT(90), PCT(99), samples[n - 1] / 1000.0);
+#undef PCT
+    }
+    if (failed) printf(" failed %d", failed);
+    printf("\n");
+    fflush(stdout);
+    free(samples);
+}
+
+int main(int argc, char* argv[]) {
+    char dir[] = "/tmp/su-bench-XXXXXX";
+    char su[sizeof(dir) + 8];
+    char default_su[PATH_MAX];
+    const char* from = NULL;
+    int64_t rss_before, pss_before, rss_after, pss_after;
+    long budget = 0;
+    int count = 200;
+    size_t i;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:hn:s:")) != -1) {
+        switch (c) {
+            case 'b':
+                budget = atol(optarg);
+                if (budget <= 0) usage(2);
+                break;
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                if (count <= 0) usage(2);
+                break;
+            case 's':
+                from = optarg;
+                break;
+            default:
+                usage(2);
+        }
+    }
+    if (optind != argc) usage(2);
+
+    if (!from) {
+        const char* slash = strrchr(argv[0], '/');
+        int len = slash ? slash - argv[0] + 1 : 0;
+        snprintf(default_su, sizeof(default_su), "%.*ssu-host", len, argv[0]);
+        from = default_su;
+    }
+    if (geteuid() != 0) {
+        fprintf(stderr, "su-bench-e2e must run as root, as the daemon does\n");
+        return EXIT_FAILURE;
+    }
+    // Whoever runs there would be measured instead, and have its socket
+    // and audit log removed from under it when we are done
+    if (daemon_up()) {
+        fprintf(stderr, "A daemon is already running in %s\n", DAEMON_SOCKET_PATH);
+        return EXIT_FAILURE;
+    }
+
+    if (!mkdtemp(dir) || chmod(dir, 0755)) {
+        fprintf(stderr, "Cannot create %s: %s\n", dir, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    snprintf(su, sizeof(su), "%s/su", dir);
+    if (copy_su(from, su)) {
+        fprintf(stderr, "Cannot copy %s: %s\n", from, strerror(errno));
+        rmdir(dir);
+        return EXIT_FAILURE;
+    }
+
+    // A debuggable Lineage build which lets both apps and adb have root,
+    // as read by su-host. The clients inherit them along with the daemon.
+    setenv("SU_HOST_PROP_ro_lineage_version", "bench", 1);
+    setenv("SU_HOST_PROP_ro_debuggable", "1", 1);
+    setenv("SU_HOST_PROP_persist_sys_root_access", "3", 1);
+
+    pid_t daemon = start_daemon(su);
+    if (daemon < 0) {
+        fprintf(stderr, "Cannot start the daemon of %s\n", su);
+        unlink(su);
+        rmdir(dir);
+        return EXIT_FAILURE;
+    }
+
+    idle_footprint(daemon, &rss_before, &pss_before);
+    printf("su -c true, %d requests per case\n", count);
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        run_case(su, &cases[i], count);
+    }
+    idle_footprint(daemon, &rss_after, &pss_after);
+    printf("idle daemon rss %lld pss %lld KiB before, rss %lld pss %lld KiB after\n",
+           (long long)rss_before, (long long)pss_before, (long long)rss_after,
+           (long long)pss_after);
+    int status = EXIT_SUCCESS;
+    if (budget && (rss_after < 0 || rss_after > budget)) {
+        printf("idle daemon over the budget of %ld KiB\n", budget);
+        status = EXIT_FAILURE;
+    }
+
+    kill(daemon, SIGTERM);
+    waitpid(daemon, NULL, 0);
+    unlink(DAEMON_SOCKET_PATH "su-daemon");
+    unlink(DAEMON_SOCKET_PATH "audit");
+    rmdir(DAEMON_SOCKET_PATH);
+    unlink(su);
+    rmdir(dir);
+    return status;
+}
@@ -0,0 +1,121 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * host.c
+ *
+ * What the host build of su needs in place of liblog, libcutils, the
+ * binder wrappers and bionic. Apps are always allowed by AppOps, and every
+ * uid from AID_APP on has a package.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/android_filesystem_config.h>
+#include <cutils/properties.h>
+
+size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+
+    if (size) {
+        size_t n = len < size ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+int su_host_log_enabled(void) {
+    return getenv("SU_HOST_LOG") != NULL;
+}
+
+void su_host_log(const char* fmt, ...) {
+    const char* path = getenv("SU_HOST_LOG");
+    va_list ap;
+
+    if (!path) return;
+    FILE* f = fopen(path, "ae");
+    if (!f) return;
+    va_start(ap, fmt);
+    fprintf(f, "%d: ", getpid());
+    vfprintf(f, fmt, ap);
+    va_end(ap);
+    fputc('\n', f);
+    fclose(f);
+}
+
+static const char* host_property(const char* key) {
+    char name[PROPERTY_VALUE_MAX + 16];
+    char* p;
+
+    snprintf(name, sizeof(name), "SU_HOST_PROP_%s", key);
+    for (p = name; *p; p++) {
+        if (*p == '.') *p = '_';
+    }
+    return getenv(name);
+}
+
+int property_get(const char* key, char* value, const char* default_value) {
+    const char* v = host_property(key);
+
+    if (!v) v = default_value ? default_value : "";
+    strlcpy(value, v, PROPERTY_VALUE_MAX);
+    return strlen(value);
+}
+
+bool property_get_bool(const char* key, bool default_value) {
+    const char* v = host_property(key);
+
+    if (!v) return default_value;
+    if (!strcmp(v, "1") || !strcmp(v, "y") || !strcmp(v, "yes") || !strcmp(v, "on") ||
+        !strcmp(v, "true")) {
+        return true;
+    }
+    if (!strcmp(v, "0") || !strcmp(v, "n") || !strcmp(v, "no") || !strcmp(v, "off") ||
+        !strcmp(v, "false")) {
+        return false;
+    }
+    return default_value;
+}
+
+int32_t property_get_int32(const char* key, int32_t default_value) {
+    const char* v = host_property(key);
+    char* end;
+
+    if (!v || !*v) return default_value;
+    long val = strtol(v, &end, 0);
+    return *end ? default_value : (int32_t)val;
+}
+
+char* resolve_package_name(int uid) {
+    return uid >= AID_APP ? strdup("org.lineageos.su.bench") : NULL;
+}
+
+int appops_start_op_su(int uid, const char* pkgName) {
+    (void)uid;
+    (void)pkgName;
+    return 0;
+}
+
+int appops_finish_op_su(int uid, const char* pkgName) {
+    (void)uid;
+    (void)pkgName;
+    return 0;
+}
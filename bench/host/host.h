@@ -0,0 +1,45 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * host.h
+ *
+ * Included ahead of everything in the host build of su, see
+ * su-bench-e2e. The headers under include/ stand in for liblog and
+ * libcutils, host.c for the binder wrappers and what bionic has but
+ * glibc does not.
+ */
+
+#ifndef _SU_HOST_H_
+#define _SU_HOST_H_
+
+// Bionic has all of these without asking
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+// Bionic has these come along with headers su includes, glibc does not
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+
+size_t strlcpy(char* dst, const char* src, size_t size);
+
+// Whether SU_HOST_LOG names a file to log to
+int su_host_log_enabled(void);
+void su_host_log(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
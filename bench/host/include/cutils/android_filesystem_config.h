@@ -0,0 +1,26 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/* Stand-in for the few Android ids su knows about. */
+
+#ifndef _SU_HOST_ANDROID_FILESYSTEM_CONFIG_H_
+#define _SU_HOST_ANDROID_FILESYSTEM_CONFIG_H_
+
+#define AID_ROOT 0
+#define AID_SHELL 2000
+#define AID_APP 10000
+
+#endif
@@ -0,0 +1,40 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/* Stand-in for ATRACE on the host, where there is nothing to trace to. */
+
+#ifndef _SU_HOST_TRACE_H_
+#define _SU_HOST_TRACE_H_
+
+#include <stdint.h>
+
+#define ATRACE_TAG_ADB (1 << 22)
+
+static inline int atrace_is_tag_enabled(uint64_t tag) {
+    (void)tag;
+    return 0;
+}
+
+static inline void atrace_begin(uint64_t tag, const char* name) {
+    (void)tag;
+    (void)name;
+}
+
+static inline void atrace_end(uint64_t tag) {
+    (void)tag;
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * Stand-in for liblog on the host. Everything is logged at the same level,
+ * to the file SU_HOST_LOG names, or nowhere.
+ */
+
+#ifndef _SU_HOST_LOG_H_
+#define _SU_HOST_LOG_H_
+
+#define ALOGV(...) su_host_log(__VA_ARGS__)
+#define ALOGD(...) su_host_log(__VA_ARGS__)
+#define ALOGI(...) su_host_log(__VA_ARGS__)
+#define ALOGW(...) su_host_log(__VA_ARGS__)
+#define ALOGE(...) su_host_log(__VA_ARGS__)
+
+#define IF_ALOG(priority, tag) if (su_host_log_enabled())
+#define IF_ALOGD() IF_ALOG(LOG_DEBUG, LOG_TAG)
+#define IF_ALOGV() IF_ALOG(LOG_VERBOSE, LOG_TAG)
+
+#endif
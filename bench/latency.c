@@ -0,0 +1,195 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * su-bench-latency
+ *
+ * Measures how long a keystroke takes to come back as echo through an
+ * interactive su session. su runs on a PTY of our own, as it would in a
+ * terminal, with cat as the command. Every key we type goes through the
+ * client's relay, the daemon's PTY, its echo, and the relay back out.
+ *
+ * Any options after -- are passed on to su, e.g. -- --low-latency.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_SU "/system/xbin/su"
+
+static void usage(int status) {
+    FILE* stream = (status == EXIT_SUCCESS) ? stdout : stderr;
+
+    fprintf(stream,
+            "Usage: su-bench-latency [options] [-- su options]\n\n"
+            "Options:\n"
+            "  -h                  display this help message and exit\n"
+            "  -i MS               wait MS milliseconds between keys, default 10\n"
+            "  -n COUNT            type COUNT keys, default 1000\n"
+            "  -s SU               run SU instead of " DEFAULT_SU "\n");
+    exit(status);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Waits up to timeout_ms for c to come back, skipping anything else
+static int wait_echo(int fd, char c, int timeout_ms) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    char buf[256];
+
+    for (;;) {
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) return -1;
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0) return -1;
+        if (memchr(buf, c, len)) return 0;
+    }
+}
+
+static pid_t spawn_su(int* master, const char* su, char** su_args, int nsu_args) {
+    char* argv[nsu_args + 4];
+    int i, argc = 0;
+
+    *master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (*master < 0 || grantpt(*master) || unlockpt(*master)) return -1;
+
+    // Give su a terminal of a sensible size
+    struct winsize ws = {.ws_row = 24, .ws_col = 80};
+    ioctl(*master, TIOCSWINSZ, &ws);
+
+    argv[argc++] = (char*)su;
+    for (i = 0; i < nsu_args; i++) {
+        argv[argc++] = su_args[i];
+    }
+    argv[argc++] = "-c";
+    argv[argc++] = "cat";
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid) return pid;
+
+    int slave = open(ptsname(*master), O_RDWR);
+    if (slave < 0 || setsid() < 0 || ioctl(slave, TIOCSCTTY, 0) < 0 ||
+        dup2(slave, STDIN_FILENO) < 0 || dup2(slave, STDOUT_FILENO) < 0 ||
+        dup2(slave, STDERR_FILENO) < 0) {
+        _exit(EXIT_FAILURE);
+    }
+    execv(su, argv);
+    _exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+    const char* su = DEFAULT_SU;
+    int count = 1000;
+    int interval_ms = 10;
+    int master, i, c;
+
+    while ((c = getopt(argc, argv, "hi:n:s:")) != -1) {
+        switch (c) {
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case 'i':
+                interval_ms = atoi(optarg);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                if (count <= 0) usage(2);
+                break;
+            case 's':
+                su = optarg;
+                break;
+            default:
+                usage(2);
+        }
+    }
+
+    pid_t pid = spawn_su(&master, su, argv + optind, argc - optind);
+    if (pid < 0) {
+        fprintf(stderr, "Cannot start %s: %s\n", su, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // Keep typing until the session is up and echoing
+    for (i = 0; i < 100; i++) {
+        if (write(master, "x", 1) == 1 && !wait_echo(master, 'x', 100)) break;
+    }
+    if (i == 100) {
+        fprintf(stderr, "No echo from %s\n", su);
+        kill(pid, SIGKILL);
+        return EXIT_FAILURE;
+    }
+    // Let anything still in flight arrive, and throw it away
+    while (!wait_echo(master, 0, 100)) {
+    }
+
+    int64_t* samples = malloc(sizeof(int64_t) * count);
+    if (!samples) return EXIT_FAILURE;
+
+    for (i = 0; i < count; i++) {
+        char key = 'a' + i % 26;
+        int64_t start = now_ns();
+        if (write(master, &key, 1) != 1 || wait_echo(master, key, 1000)) {
+            fprintf(stderr, "Lost the echo of key %d\n", i);
+            kill(pid, SIGKILL);
+            return EXIT_FAILURE;
+        }
+        samples[i] = now_ns() - start;
+        if (interval_ms > 0) usleep(interval_ms * 1000);
+    }
+
+    // End cat's line and its input, which ends the session
+    write(master, "\n\4", 2);
+    waitpid(pid, NULL, 0);
+
+    int64_t total = 0;
+    for (i = 0; i < count; i++) {
+        total += samples[i];
+    }
+    qsort(samples, count, sizeof(int64_t), cmp_int64);
+
+#define PCT(p) (samples[(count - 1) * (p) / 100] / 1000.0)
+    printf("keys %d\n", count);
+    printf("mean %.1f us\n", total / count / 1000.0);
+    printf("p50  %.1f us\n", PCT(50));
+    printf("p90  %.1f us\n", PCT(90));
+    printf("p99  %.1f us\n", PCT(99));
+    printf("max  %.1f us\n", samples[count - 1] / 1000.0);
+
+    free(samples);
+    return EXIT_SUCCESS;
+}
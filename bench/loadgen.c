@@ -0,0 +1,447 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * su-loadgen
+ *
+ * Puts the daemon under load, to see how it copes with connections piling
+ * up behind listen() and with forking for all of them at once. It speaks
+ * the wire protocol itself, so no su client is started for a request, and
+ * keeps a number of connections going at the same time.
+ *
+ * Requests arrive at a fixed rate when one is given, and their latency is
+ * counted from when they were due, so falling behind shows up in it. With
+ * no rate, every connection sends its next request as soon as the last
+ * one is over.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "su.h"
+#include "wire.h"
+
+#define MAX_COMMANDS 16
+#define SAMPLE_MS 100
+
+enum error_kind {
+    ERROR_CONNECT,
+    ERROR_HANDSHAKE,
+    ERROR_EXIT,
+    ERROR_STATUS,
+    ERROR_KINDS,
+};
+
+static const char* const error_names[ERROR_KINDS] = {
+    NULL, "handshake", "no exit code", "exit status",
+};
+
+struct command {
+    int weight;
+    const char* cmd;
+};
+
+static struct command commands[MAX_COMMANDS];
+static int command_count, total_weight;
+
+static int connections = 10;
+static int count = 1000;
+static double rate;
+static int nonblocking;
+static int null_fd;
+
+static int64_t start;
+static int next_ticket;
+// Per request, or -1 when it failed
+static int64_t* latencies;
+static int64_t* handshakes;
+
+static int errors[ERROR_KINDS];
+// Why connecting failed, by errno
+static int connect_errors[256];
+
+// Sampled from the daemon while the requests run
+static pid_t daemon_pid;
+static volatile int done;
+static long rss_first, rss_peak;
+static int procs_peak, samples;
+static long procs_total;
+
+static void usage(int status) {
+    FILE* stream = (status == EXIT_SUCCESS) ? stdout : stderr;
+
+    fprintf(stream,
+            "Usage: su-loadgen [options]\n\n"
+            "Options:\n"
+            "  -b                  connect without blocking, to see the backlog overflow\n"
+            "  -c CONNECTIONS      keep up to CONNECTIONS requests going, default 10\n"
+            "  -h                  display this help message and exit\n"
+            "  -m [WEIGHT:]COMMAND run COMMAND in WEIGHT of the requests, may be repeated,\n"
+            "                      true by default\n"
+            "  -n COUNT            send COUNT requests, default 1000\n"
+            "  -p PID              sample the memory and processes of the daemon at PID\n"
+            "  -r RATE             send RATE requests a second, as fast as possible by "
+            "default\n");
+    exit(status);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// A whole number from 1 to INT_MAX, anything else is a usage error
+static int positive_arg(const char* arg) {
+    char* end;
+
+    errno = 0;
+    long val = strtol(arg, &end, 10);
+    if (errno || end == arg || *end || val <= 0 || val > INT_MAX) usage(2);
+    return val;
+}
+
+static void add_command(const char* arg) {
+    const char* colon = strchr(arg, ':');
+    char* end;
+    int weight = 1;
+
+    if (colon) {
+        weight = strtol(arg, &end, 10);
+        if (end == colon) {
+            arg = colon + 1;
+        } else {
+            // Not a weight, the colon is part of the command
+            weight = 1;
+        }
+    }
+    if (weight <= 0 || command_count == MAX_COMMANDS) usage(2);
+    commands[command_count].weight = weight;
+    commands[command_count].cmd = arg;
+    command_count++;
+    total_weight += weight;
+}
+
+static const char* pick_command(unsigned* seed) {
+    int w = rand_r(seed) % total_weight;
+    int i;
+
+    for (i = 0; w >= commands[i].weight; i++) {
+        w -= commands[i].weight;
+    }
+    return commands[i].cmd;
+}
+
+static void count_error(enum error_kind kind, int err) {
+    __atomic_fetch_add(&errors[kind], 1, __ATOMIC_RELAXED);
+    if (kind == ERROR_CONNECT && err >= 0 && err < 256) {
+        __atomic_fetch_add(&connect_errors[err], 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int open_daemon(void) {
+    struct sockaddr_un sun;
+
+    int fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0), 0);
+    if (fd < 0) return -1;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_LOCAL;
+    snprintf(sun.sun_path, sizeof(sun.sun_path), "%s/su-daemon", DAEMON_SOCKET_PATH);
+    if (connect(fd, (struct sockaddr*)&sun, sizeof(sun)) ||
+        (nonblocking && fcntl(fd, F_SETFL, 0))) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// The same handshake as su_client_start(), with /dev/null for stdio
+static int send_request(int fd, const char* cmd) {
+    const char* argv[] = {"su", "-c", cmd};
+    int ack, i;
+
+    if (wire_write_int(fd, PROTO_VERSION) || wire_write_int(fd, getpid()) ||
+        wire_write_int(fd, getpid()) || wire_write_int(fd, 0)) {
+        return -1;
+    }
+    for (i = 0; i < 3; i++) {
+        if (wire_send_fd(fd, null_fd)) return -1;
+    }
+    if (wire_write_int(fd, 3)) return -1;
+    for (i = 0; i < 3; i++) {
+        if (wire_write_string(fd, argv[i])) return -1;
+    }
+    return wire_read_int(fd, &ack) || ack != PROTO_VERSION ? -1 : 0;
+}
+
+static void run_request(int ticket, unsigned* seed) {
+    int64_t due = now_ns();
+    int code;
+
+    latencies[ticket] = handshakes[ticket] = -1;
+    if (rate > 0) {
+        struct timespec ts;
+        due = start + (int64_t)(ticket * 1000000000.0 / rate);
+        ts.tv_sec = due / 1000000000LL;
+        ts.tv_nsec = due % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+
+    int fd = open_daemon();
+    if (fd < 0) {
+        count_error(ERROR_CONNECT, errno);
+        return;
+    }
+    if (send_request(fd, pick_command(seed))) {
+        count_error(ERROR_HANDSHAKE, 0);
+        close(fd);
+        return;
+    }
+    handshakes[ticket] = now_ns() - due;
+    int ret = wire_read_int(fd, &code);
+    int64_t end = now_ns();
+    close(fd);
+    if (ret) {
+        count_error(ERROR_EXIT, 0);
+        return;
+    }
+    if (code) {
+        count_error(ERROR_STATUS, 0);
+        return;
+    }
+    latencies[ticket] = end - due;
+}
+
+static void* worker(void* arg) {
+    unsigned seed = (uintptr_t)arg;
+    int ticket;
+
+    while ((ticket = __atomic_fetch_add(&next_ticket, 1, __ATOMIC_RELAXED)) < count) {
+        run_request(ticket, &seed);
+    }
+    return NULL;
+}
+
+static long read_rss_kb(pid_t pid) {
+    char path[64], line[256];
+    long rss = -1;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE* f = fopen(path, "re");
+    if (!f) return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmRSS: %ld", &rss) == 1) break;
+    }
+    fclose(f);
+    return rss;
+}
+
+// Processes still running su: the daemon, and what it forked for requests
+// which have not executed their command yet or are waiting for it
+static int count_su_processes(const char* exe) {
+    char path[PATH_MAX], link[PATH_MAX];
+    struct dirent* de;
+    int n = 0;
+
+    DIR* dir = opendir("/proc");
+    if (!dir) return -1;
+    while ((de = readdir(dir))) {
+        if (de->d_name[0] < '0' || de->d_name[0] > '9') continue;
+        snprintf(path, sizeof(path), "/proc/%s/exe", de->d_name);
+        ssize_t len = readlink(path, link, sizeof(link) - 1);
+        if (len < 0) continue;
+        link[len] = '\0';
+        if (!strcmp(link, exe)) n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+static void* sampler(void* arg) {
+    char path[64], exe[PATH_MAX];
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = SAMPLE_MS * 1000000L};
+    (void)arg;
+
+    snprintf(path, sizeof(path), "/proc/%d/exe", daemon_pid);
+    ssize_t len = readlink(path, exe, sizeof(exe) - 1);
+    if (len < 0) {
+        fprintf(stderr, "Cannot sample daemon %d: %s\n", daemon_pid, strerror(errno));
+        return NULL;
+    }
+    exe[len] = '\0';
+
+    while (!__atomic_load_n(&done, __ATOMIC_RELAXED)) {
+        long rss = read_rss_kb(daemon_pid);
+        int procs = count_su_processes(exe);
+        if (rss >= 0) {
+            if (!samples) rss_first = rss;
+            if (rss > rss_peak) rss_peak = rss;
+        }
+        if (procs > procs_peak) procs_peak = procs;
+        procs_total += procs;
+        samples++;
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+// Sorts the successful ones to the front, returns how many there are
+static int successful(int64_t* v) {
+    int i, n = 0;
+
+    for (i = 0; i < count; i++) {
+        if (v[i] >= 0) v[n++] = v[i];
+    }
+    qsort(v, n, sizeof(int64_t), cmp_int64);
+    return n;
+}
+
+static void print_latency(const char* name, int64_t* v) {
+    int n = successful(v);
+
+    printf("%-9s", name);
+    if (n) {
+#define PERMILLE(p) (v[(int64_t)(n - 1) * (p) / 1000] / 1000.0)
+        printf(" p50 %9.1f p99 %9.1f p999 %9.1f max %9.1f us", PERMILLE(500), PERMILLE(990),
+               PERMILLE(999), v[n - 1] / 1000.0);
+#undef PERMILLE
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    pthread_t* threads;
+    pthread_t sample_thread;
+    int i, c;
+
+    while ((c = getopt(argc, argv, "bc:hm:n:p:r:")) != -1) {
+        switch (c) {
+            case 'b':
+                nonblocking = 1;
+                break;
+            case 'c':
+                connections = positive_arg(optarg);
+                break;
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case 'm':
+                add_command(optarg);
+                break;
+            case 'n':
+                count = positive_arg(optarg);
+                break;
+            case 'p':
+                daemon_pid = positive_arg(optarg);
+                break;
+            case 'r': {
+                char* end;
+                errno = 0;
+                rate = strtod(optarg, &end);
+                if (errno || end == optarg || *end || !(rate >= 0)) usage(2);
+                break;
+            }
+            default:
+                usage(2);
+        }
+    }
+    if (optind != argc) usage(2);
+    if (!command_count) add_command("true");
+    if (connections > count) connections = count;
+
+    null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    latencies = malloc(sizeof(int64_t) * count);
+    handshakes = malloc(sizeof(int64_t) * count);
+    threads = malloc(sizeof(pthread_t) * connections);
+    if (null_fd < 0 || !latencies || !handshakes || !threads) {
+        fprintf(stderr, "Cannot set up: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (daemon_pid && pthread_create(&sample_thread, NULL, sampler, NULL)) {
+        fprintf(stderr, "Cannot start sampling\n");
+        daemon_pid = 0;
+    }
+
+    start = now_ns();
+    for (i = 0; i < connections; i++) {
+        if (pthread_create(&threads[i], NULL, worker, (void*)(uintptr_t)(i + 1))) {
+            fprintf(stderr, "Cannot start connection %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    for (i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    if (daemon_pid) {
+        __atomic_store_n(&done, 1, __ATOMIC_RELAXED);
+        pthread_join(sample_thread, NULL);
+    }
+
+    int failed = 0;
+    for (i = 0; i < ERROR_KINDS; i++) {
+        failed += errors[i];
+    }
+    printf("requests %d connections %d rate ", count, connections);
+    if (rate > 0) {
+        printf("%.1f/s\n", rate);
+    } else {
+        printf("max\n");
+    }
+    printf("completed %d failed %d in %.3f s, %.1f/s\n", count - failed, failed, elapsed,
+           (count - failed) / elapsed);
+    print_latency("request", latencies);
+    print_latency("handshake", handshakes);
+    // Failing to connect is broken down by the reason for it
+    for (i = ERROR_CONNECT + 1; i < ERROR_KINDS; i++) {
+        if (!errors[i]) continue;
+        printf("error %s %d\n", error_names[i], errors[i]);
+    }
+    for (i = 0; i < 256; i++) {
+        if (!connect_errors[i]) continue;
+        printf("error connect %s %d\n", strerror(i), connect_errors[i]);
+    }
+    if (daemon_pid && samples) {
+        printf("daemon rss %ld kB peak %ld kB, su processes mean %.1f peak %d\n", rss_first,
+               rss_peak, (double)procs_total / samples, procs_peak);
+    }
+
+    free(threads);
+    free(handshakes);
+    free(latencies);
+    close(null_fd);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,290 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * su-bench-relay
+ *
+ * Measures how fast pump_relay() moves bulk data through a real PTY, and
+ * what it costs. The relay runs in a process of its own, so that its CPU
+ * time and context switches can be told apart from those of whoever is
+ * writing and reading.
+ *
+ * Output goes from a writer on the PTY slave through the relay to a pipe
+ * on its stdout, and input from a pipe on its stdin through the relay to
+ * a reader on the slave. The writer goes at its chunk size, as fast as it
+ * can. A fast reader takes whatever is there, a slow one takes a little
+ * at a time and pauses in between, as a terminal on a slow link would.
+ *
+ * With -r, the output cases are run once more while recording to a file,
+ * as su --record does.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pts.h"
+
+struct reader {
+    const char* name;
+    size_t size;
+    long pause_us;
+};
+
+static const struct reader readers[] = {
+    {"fast", 65536, 0},
+    {"slow", 4096, 100},
+};
+
+static const size_t chunks[] = {64, 4096, 65536};
+
+static const char* record_path;
+
+static void usage(int status) {
+    FILE* stream = (status == EXIT_SUCCESS) ? stdout : stderr;
+
+    fprintf(stream,
+            "Usage: su-bench-relay [options]\n\n"
+            "Options:\n"
+            "  -h                  display this help message and exit\n"
+            "  -m MIB              move MIB MiB per case, default 64\n"
+            "  -r FILE             also run the output cases recording to FILE\n");
+    exit(status);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void write_all(int fd, size_t total, size_t chunk) {
+    char* buf = malloc(chunk);
+
+    if (!buf) _exit(EXIT_FAILURE);
+    memset(buf, 'x', chunk);
+    while (total) {
+        size_t want = total < chunk ? total : chunk;
+        ssize_t len = write(fd, buf, want);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            _exit(EXIT_FAILURE);
+        }
+        total -= len;
+    }
+    free(buf);
+}
+
+// Returns how much was read before the end, or total
+static size_t read_all(int fd, size_t total, const struct reader* r) {
+    char* buf = malloc(r->size);
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = r->pause_us * 1000};
+    size_t seen = 0;
+
+    if (!buf) _exit(EXIT_FAILURE);
+    while (seen < total) {
+        ssize_t len = read(fd, buf, r->size);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+        seen += len;
+        if (r->pause_us) nanosleep(&pause, NULL);
+    }
+    free(buf);
+    return seen;
+}
+
+// Nothing on the slave may get in the way of the data
+static void make_raw(int fd) {
+    struct termios t;
+
+    if (tcgetattr(fd, &t) == 0) {
+        cfmakeraw(&t);
+        tcsetattr(fd, TCSANOW, &t);
+    }
+}
+
+// The relay must not hold the slave open, or it never sees it hang up
+static pid_t start_relay(int ptmx, int slave, int sockfd, int in, int out, int flags,
+                         int record) {
+    pid_t pid = fork();
+    if (pid) return pid;
+
+    close(slave);
+    if (dup2(in, STDIN_FILENO) < 0 || dup2(out, STDOUT_FILENO) < 0) _exit(EXIT_FAILURE);
+    pump_relay(ptmx, sockfd, flags, record, NULL);
+    _exit(EXIT_SUCCESS);
+}
+
+static void report(const char* dir, size_t chunk, const char* reader, const char* mode,
+                   size_t total, int64_t ns, const struct rusage* ru, int failed) {
+    double mib = total / 1048576.0;
+    double cpu_ms = (ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1e3 +
+                    (ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) / 1e3;
+
+    printf("%-6s chunk %6zu %-4s %-7s %9.1f MiB/s %8.3f cpu ms/MiB %8.1f switches/MiB", dir,
+           chunk, reader, mode, mib / (ns / 1e9), cpu_ms / mib,
+           (ru->ru_nvcsw + ru->ru_nivcsw) / mib);
+    if (failed) printf(" failed");
+    printf("\n");
+    fflush(stdout);
+}
+
+// From a writer on the slave, through the relay, to a reader on its stdout
+static void bench_output(size_t total, size_t chunk, const struct reader* r, int low_latency,
+                         int recording) {
+    struct rusage ru;
+    int sock[2], out[2], slave, status;
+    int record = -1;
+
+    int ptmx = pts_open(&slave);
+    if (ptmx < 0 || pipe2(out, O_CLOEXEC) ||
+        socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, sock)) {
+        perror("setup");
+        exit(EXIT_FAILURE);
+    }
+    make_raw(slave);
+    int null = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (recording) {
+        record = open(record_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (record < 0) {
+            perror(record_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int64_t start = now_ns();
+    pid_t relay = start_relay(ptmx, slave, sock[1], null, out[1],
+                              PUMP_STDOUT | (low_latency ? PUMP_LOW_LATENCY : 0), record);
+    pid_t writer = fork();
+    if (!writer) {
+        close(ptmx);
+        close(out[0]);
+        close(out[1]);
+        write_all(slave, total, chunk);
+        _exit(EXIT_SUCCESS);
+    }
+    // The PTY hangs up once the writer is done, and only the writer has it
+    close(slave);
+    close(ptmx);
+    close(out[1]);
+    close(null);
+    if (record >= 0) close(record);
+
+    size_t seen = read_all(out[0], total, r);
+    waitpid(writer, NULL, 0);
+    int ret = wait4(relay, &status, 0, &ru);
+    int64_t ns = now_ns() - start;
+
+    report("output", chunk, r->name, recording ? "record" : low_latency ? "low-lat" : "batched",
+           total, ns, &ru,
+           seen != total || ret != relay);
+    close(out[0]);
+    close(sock[0]);
+    close(sock[1]);
+}
+
+// From a writer on the relay's stdin, through the relay, to a reader on the slave
+static void bench_input(size_t total, size_t chunk, const struct reader* r) {
+    struct rusage ru;
+    int sock[2], in[2], slave, status;
+
+    int ptmx = pts_open(&slave);
+    if (ptmx < 0 || pipe2(in, O_CLOEXEC) ||
+        socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, sock)) {
+        perror("setup");
+        exit(EXIT_FAILURE);
+    }
+    make_raw(slave);
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    int64_t start = now_ns();
+    pid_t relay = start_relay(ptmx, slave, sock[1], in[0], null, PUMP_STDIN, -1);
+    pid_t reader = fork();
+    if (!reader) {
+        close(ptmx);
+        close(in[0]);
+        close(in[1]);
+        // Closing the slave when done hangs the PTY up, which ends the relay
+        _exit(read_all(slave, total, r) == total ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(slave);
+    close(ptmx);
+    close(in[0]);
+    close(null);
+
+    write_all(in[1], total, chunk);
+    close(in[1]);
+    int ret = wait4(relay, &status, 0, &ru);
+    int64_t ns = now_ns() - start;
+    int failed = waitpid(reader, &status, 0) != reader || !WIFEXITED(status) ||
+                 WEXITSTATUS(status) != EXIT_SUCCESS;
+
+    report("input", chunk, r->name, "", total, ns, &ru, failed || ret != relay);
+    close(sock[0]);
+    close(sock[1]);
+}
+
+int main(int argc, char* argv[]) {
+    size_t total = 64 << 20;
+    size_t i, j;
+    int c;
+
+    while ((c = getopt(argc, argv, "hm:r:")) != -1) {
+        switch (c) {
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case 'm':
+                if (atoi(optarg) <= 0) usage(2);
+                total = (size_t)atoi(optarg) << 20;
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            default:
+                usage(2);
+        }
+    }
+    if (optind != argc) usage(2);
+
+    // A writer which is done early must not take us down
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%zu MiB per case\n", total >> 20);
+    for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        for (j = 0; j < sizeof(readers) / sizeof(readers[0]); j++) {
+            bench_output(total, chunks[i], &readers[j], 0, 0);
+            bench_output(total, chunks[i], &readers[j], 1, 0);
+            if (record_path) bench_output(total, chunks[i], &readers[j], 0, 1);
+        }
+    }
+    for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        for (j = 0; j < sizeof(readers) / sizeof(readers[0]); j++) {
+            bench_input(total, chunks[i], &readers[j]);
+        }
+    }
+    return EXIT_SUCCESS;
+}
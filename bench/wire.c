@@ -0,0 +1,319 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * su-bench-wire
+ *
+ * Measures the wire encoding of wire.c over a socketpair: ints, strings
+ * and descriptors on their own, then whole requests of several shapes,
+ * from a few short arguments to 512 long ones. The client sends from a
+ * thread of its own while the daemon side reads them, as they would.
+ *
+ * The syscalls wire.c makes are counted as well, by linking it with
+ * --wrap for each of them, see Android.mk. They are given per request,
+ * for the side sending it and for the side reading it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "su.h"
+#include "wire.h"
+
+struct shape {
+    const char* name;
+    int argc;
+    int len;
+};
+
+static const struct shape shapes[] = {
+    {"request 3x8", 3, 8},
+    {"request 16x32", 16, 32},
+    {"request 128x64", 128, 64},
+    {"request 512x256", 512, 256},
+};
+
+/*
+ * The syscalls made by this thread. Only what wire.c calls is wrapped, so
+ * that is all these count.
+ */
+static __thread long syscalls;
+
+ssize_t __real_read(int fd, void* buf, size_t count);
+ssize_t __real_send(int fd, const void* buf, size_t len, int flags);
+ssize_t __real_sendmsg(int fd, const struct msghdr* msg, int flags);
+ssize_t __real_recvmsg(int fd, struct msghdr* msg, int flags);
+int __real_fcntl(int fd, int cmd, ...);
+
+ssize_t __wrap_read(int fd, void* buf, size_t count) {
+    syscalls++;
+    return __real_read(fd, buf, count);
+}
+
+ssize_t __wrap_send(int fd, const void* buf, size_t len, int flags) {
+    syscalls++;
+    return __real_send(fd, buf, len, flags);
+}
+
+ssize_t __wrap_sendmsg(int fd, const struct msghdr* msg, int flags) {
+    syscalls++;
+    return __real_sendmsg(fd, msg, flags);
+}
+
+ssize_t __wrap_recvmsg(int fd, struct msghdr* msg, int flags) {
+    syscalls++;
+    return __real_recvmsg(fd, msg, flags);
+}
+
+int __wrap_fcntl(int fd, int cmd, ...) {
+    va_list ap;
+
+    va_start(ap, cmd);
+    long arg = va_arg(ap, long);
+    va_end(ap);
+    syscalls++;
+    return __real_fcntl(fd, cmd, arg);
+}
+
+struct client {
+    int fd;
+    int count;
+    char** argv;
+    int argc;
+    long syscalls;
+    int failed;
+};
+
+static int null_fd;
+
+static void usage(int status) {
+    FILE* stream = (status == EXIT_SUCCESS) ? stdout : stderr;
+
+    fprintf(stream,
+            "Usage: su-bench-wire [options]\n\n"
+            "Options:\n"
+            "  -h                  display this help message and exit\n"
+            "  -n COUNT            repeat everything COUNT times, default 10000\n");
+    exit(status);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char* name, int count, int64_t ns, long sender, long reader, int failed) {
+    printf("%-16s %9.2f us %6.1f syscalls sending %6.1f reading", name, ns / 1000.0 / count,
+           (double)sender / count, (double)reader / count);
+    if (failed) printf(" failed %d", failed);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Each of these sends one and reads it back, the socket buffer holds it
+
+static int int_once(int fds[2], long* sender) {
+    int val;
+
+    long before = syscalls;
+    int ret = wire_write_int(fds[0], 42);
+    *sender += syscalls - before;
+    return ret || wire_read_int(fds[1], &val) || val != 42;
+}
+
+static int string_once(int fds[2], long* sender) {
+    char* val;
+
+    long before = syscalls;
+    int ret = wire_write_string(fds[0], "/system/bin/sh -c id");
+    *sender += syscalls - before;
+    if (ret || wire_read_string(fds[1], &val)) return -1;
+    free(val);
+    return 0;
+}
+
+static int fd_once(int fds[2], long* sender) {
+    int fd;
+
+    long before = syscalls;
+    int ret = wire_send_fd(fds[0], null_fd);
+    *sender += syscalls - before;
+    if (ret || wire_recv_fd(fds[1], &fd) || fd < 0) return -1;
+    close(fd);
+    return 0;
+}
+
+static void bench_op(const char* name, int count, int (*op)(int[2], long*)) {
+    int fds[2];
+    long sender = 0;
+    int i, failed = 0;
+
+    if (socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) {
+        perror("socketpair");
+        exit(EXIT_FAILURE);
+    }
+    long before = syscalls;
+    int64_t start = now_ns();
+    for (i = 0; i < count; i++) {
+        if (op(fds, &sender)) failed++;
+    }
+    int64_t ns = now_ns() - start;
+    report(name, count, ns, sender, syscalls - before - sender, failed);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// What su_client_start() sends, then waits for the acknowledgement
+static void* client_thread(void* arg) {
+    struct client* c = arg;
+    int i, j, ack;
+
+    for (i = 0; i < c->count; i++) {
+        if (wire_write_int(c->fd, PROTO_VERSION) || wire_write_int(c->fd, getpid()) ||
+            wire_write_int(c->fd, getpid()) || wire_write_int(c->fd, 0) ||
+            wire_send_fd(c->fd, null_fd) || wire_send_fd(c->fd, null_fd) ||
+            wire_send_fd(c->fd, null_fd) || wire_write_int(c->fd, c->argc)) {
+            c->failed++;
+            break;
+        }
+        for (j = 0; j < c->argc; j++) {
+            if (wire_write_string(c->fd, c->argv[j])) break;
+        }
+        if (j < c->argc || wire_read_int(c->fd, &ack) || ack != PROTO_VERSION) {
+            c->failed++;
+            break;
+        }
+    }
+    c->syscalls = syscalls;
+    return NULL;
+}
+
+// What daemon_accept() reads, then acknowledges
+static int read_request(int fd) {
+    int version, pid, ppid, flags, argc, stdio[3];
+    int i;
+
+    if (wire_read_int(fd, &version) || version != PROTO_VERSION || wire_read_int(fd, &pid) ||
+        wire_read_int(fd, &ppid) || wire_read_int(fd, &flags)) {
+        return -1;
+    }
+    for (i = 0; i < 3; i++) {
+        if (wire_recv_fd(fd, &stdio[i])) return -1;
+    }
+    for (i = 0; i < 3; i++) {
+        if (stdio[i] >= 0) close(stdio[i]);
+    }
+    if (wire_read_int(fd, &argc) || argc < 0) return -1;
+    for (i = 0; i < argc; i++) {
+        char* arg;
+        if (wire_read_string(fd, &arg)) return -1;
+        free(arg);
+    }
+    return wire_write_int(fd, PROTO_VERSION);
+}
+
+static void bench_request(const struct shape* shape, int count) {
+    struct client c = {.count = count, .argc = shape->argc};
+    pthread_t thread;
+    int fds[2];
+    int i;
+
+    c.argv = malloc(sizeof(char*) * shape->argc);
+    if (!c.argv) exit(EXIT_FAILURE);
+    for (i = 0; i < shape->argc; i++) {
+        c.argv[i] = malloc(shape->len + 1);
+        if (!c.argv[i]) exit(EXIT_FAILURE);
+        memset(c.argv[i], 'a' + i % 26, shape->len);
+        c.argv[i][shape->len] = '\0';
+    }
+    if (socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) {
+        perror("socketpair");
+        exit(EXIT_FAILURE);
+    }
+    c.fd = fds[0];
+
+    long before = syscalls;
+    int64_t start = now_ns();
+    if (pthread_create(&thread, NULL, client_thread, &c)) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < count; i++) {
+        if (read_request(fds[1])) {
+            // Let the client see it is over, and count it as the failure
+            shutdown(fds[1], SHUT_RDWR);
+            break;
+        }
+    }
+    pthread_join(thread, NULL);
+    int64_t ns = now_ns() - start;
+    report(shape->name, count, ns, c.syscalls, syscalls - before, c.failed);
+
+    close(fds[0]);
+    close(fds[1]);
+    for (i = 0; i < shape->argc; i++) {
+        free(c.argv[i]);
+    }
+    free(c.argv);
+}
+
+int main(int argc, char* argv[]) {
+    int count = 10000;
+    size_t i;
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:")) != -1) {
+        switch (c) {
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case 'n':
+                count = atoi(optarg);
+                if (count <= 0) usage(2);
+                break;
+            default:
+                usage(2);
+        }
+    }
+    if (optind != argc) usage(2);
+
+    null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd < 0) {
+        perror("/dev/null");
+        return EXIT_FAILURE;
+    }
+
+    printf("%d times each, per operation\n", count);
+    bench_op("int", count, int_once);
+    bench_op("string 20", count, string_once);
+    bench_op("fd", count, fd_once);
+    for (i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        bench_request(&shapes[i], count);
+    }
+
+    close(null_fd);
+    return EXIT_SUCCESS;
+}
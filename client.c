@@ -0,0 +1,581 @@
+/*
+** Copyright 2010, Adam Shanks (@ChainsDD)
+** Copyright 2008, Zinx Verituse (@zinxv)
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * client.c
+ *
+ * The client side of the su daemon protocol. Built into libsuclient, which
+ * both the su binary and native callers that want root without spawning su
+ * link against.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "pts.h"
+#include "su.h"
+#include "su_client.h"
+#include "trace.h"
+#include "wire.h"
+
+// Constants for the atty bitfield
+#define ATTY_IN 1
+#define ATTY_OUT 2
+#define ATTY_ERR 4
+
+// When we got to each stage of a --profile request, see struct su_profile
+struct client_profile {
+    int64_t start;
+    int64_t connected;
+    int64_t acknowledged;
+    int64_t first_output;
+    int64_t finished;
+};
+
+// The su binary has no way to recover from a broken daemon connection
+
+static void send_fd(int sockfd, int fd) {
+    if (wire_send_fd(sockfd, fd)) exit(-1);
+}
+
+static int read_int(int fd) {
+    int val;
+    if (wire_read_int(fd, &val)) exit(-1);
+    return val;
+}
+
+static void request_failed(void) {
+    // Most likely the daemon of the su we were replaced by is still running
+    if (errno == EPROTO) fprintf(stderr, "su daemon speaks another protocol version\n");
+    exit(-1);
+}
+
+static void master_socket_addr(struct sockaddr_un* sun, socklen_t* len, unsigned uid) {
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_LOCAL;
+    // Abstract socket, the leading NUL is part of the name
+    *len = offsetof(struct sockaddr_un, sun_path) + 1 +
+           snprintf(sun->sun_path + 1, sizeof(sun->sun_path) - 1, "su-master-%u", uid);
+}
+
+static unsigned socket_peer_uid(int fd) {
+    struct ucred credentials;
+    socklen_t ucred_length = sizeof(struct ucred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &ucred_length)) {
+        return (unsigned)-1;
+    }
+    return credentials.uid;
+}
+
+/*
+ * Connects to the su --master session of the calling uid, if there is one.
+ * Abstract sockets can be bound by anyone, so the master must be running as
+ * the same uid as we are.
+ *
+ * Returns the connected socket, or -1 if there is no usable master.
+ */
+static int attach_master(void) {
+    struct sockaddr_un sun;
+    socklen_t len;
+
+    int fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    master_socket_addr(&sun, &len, getuid());
+    if (connect(fd, (struct sockaddr*)&sun, len) || socket_peer_uid(fd) != getuid()) {
+        close(fd);
+        return -1;
+    }
+
+    ALOGV("attached to master session");
+    return fd;
+}
+
+static int open_daemon_socket(void) {
+    struct sockaddr_un sun;
+
+    // Open a socket to the daemon
+    int socketfd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socketfd < 0) {
+        PLOGE("socket");
+        return -1;
+    }
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_LOCAL;
+    sprintf(sun.sun_path, "%s/su-daemon", DAEMON_SOCKET_PATH);
+
+    if (0 != connect(socketfd, (struct sockaddr*)&sun, sizeof(sun))) {
+        PLOGE("connect");
+        close(socketfd);
+        return -1;
+    }
+
+    return socketfd;
+}
+
+static int write_request(int socketfd, int ppid, int flags, int infd, int outfd, int errfd,
+                         int argc, const char* const argv[]) {
+    int sent = 0;
+    int ack, err;
+    int i;
+
+    // The version of the protocol, which the rest is in
+    if (wire_write_int(socketfd, PROTO_VERSION)) goto ack;
+
+    // Send some info to the daemon, starting with our PID
+    if (wire_write_int(socketfd, getpid())) goto ack;
+    // Parent PID
+    if (wire_write_int(socketfd, ppid)) goto ack;
+    // SU_REQUEST_* flags
+    if (wire_write_int(socketfd, flags)) goto ack;
+
+    // Send stdin, stdout and stderr. Those on a terminal are the PTY slave.
+    if (wire_send_fd(socketfd, infd)) goto ack;
+    if (wire_send_fd(socketfd, outfd)) goto ack;
+    if (wire_send_fd(socketfd, errfd)) goto ack;
+
+    // Number of command line arguments
+    if (wire_write_int(socketfd, argc)) goto ack;
+
+    // Command line arguments
+    for (i = 0; i < argc; i++) {
+        if (wire_write_string(socketfd, argv[i])) goto ack;
+    }
+    sent = 1;
+
+ack:
+    // A daemon still waiting for the rest would never answer
+    err = errno;
+    if (!sent) shutdown(socketfd, SHUT_WR);
+
+    // Wait for acknowledgement from daemon. One which speaks another
+    // version hangs up without taking the rest of the request, but what it
+    // answered is still there to be read.
+    errno = 0;
+    if (wire_read_int(socketfd, &ack)) {
+        // Why sending failed, or else why reading did, an EOF included
+        errno = !sent ? err : errno ? errno : ECONNRESET;
+        return -1;
+    }
+    if (ack != PROTO_VERSION) {
+        ALOGE("daemon speaks protocol %d, not %d", ack, PROTO_VERSION);
+        errno = EPROTO;
+        return -1;
+    }
+    if (!sent) errno = err;
+    return sent ? 0 : -1;
+}
+
+/*
+ * Sends a request and waits for the daemon to acknowledge it.
+ *
+ * Returns 0 on success, or -1 on failure. errno is EPROTO if the daemon
+ * speaks another version of the protocol.
+ */
+static int send_request(int socketfd, int ppid, int flags, int infd, int outfd, int errfd,
+                        int argc, const char* const argv[]) {
+    trace_begin("send_request", getpid());
+    int ret = write_request(socketfd, ppid, flags, infd, outfd, errfd, argc, argv);
+    int err = errno;
+    trace_end();
+    errno = err;
+    return ret;
+}
+
+int su_client_start(const char* const argv[], int infd, int outfd, int errfd) {
+    int argc = 0;
+    while (argv[argc]) argc++;
+
+    // Requests go through our uid's master session when one is running
+    int socketfd = attach_master();
+    if (socketfd < 0) {
+        socketfd = open_daemon_socket();
+        if (socketfd < 0) return -1;
+    }
+
+    // We are the process asking for root, not our parent
+    // errno says why, EPROTO only if the daemon speaks another protocol
+    if (send_request(socketfd, getpid(), 0, infd, outfd, errfd, argc, argv)) {
+        int err = errno;
+        close(socketfd);
+        errno = err;
+        return -1;
+    }
+
+    return socketfd;
+}
+
+int su_client_finish(int fd) {
+    int code;
+    int ret = wire_read_int(fd, &code);
+    close(fd);
+    if (ret) {
+        errno = EPROTO;
+        return -1;
+    }
+    return code;
+}
+
+int su_client_exec(const char* const argv[], int infd, int outfd, int errfd) {
+    int fd = su_client_start(argv, infd, outfd, errfd);
+    if (fd < 0) return -1;
+    return su_client_finish(fd);
+}
+
+/*
+ * Runs a su --master session: starts an authorized session in the daemon,
+ * then forwards every connection made to the per-uid control socket into
+ * it until the session ends or we are killed.
+ */
+int run_master(int argc, char* argv[], int ppid) {
+    struct sockaddr_un sun;
+    socklen_t len;
+    int control[2];
+
+    int listenfd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenfd < 0) {
+        PLOGE("socket");
+        exit(-1);
+    }
+    master_socket_addr(&sun, &len, getuid());
+    if (bind(listenfd, (struct sockaddr*)&sun, len) || listen(listenfd, 10)) {
+        fprintf(stderr, "Cannot start master session: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, control)) {
+        PLOGE("socketpair");
+        exit(-1);
+    }
+
+    int socketfd = open_daemon_socket();
+    if (socketfd < 0) exit(-1);
+
+    // The session reads forwarded connections from its stdin
+    if (send_request(socketfd, ppid, 0, control[1], STDOUT_FILENO, STDERR_FILENO, argc,
+                     (const char* const*)argv)) {
+        request_failed();
+    }
+    close(control[1]);
+
+    struct pollfd fds[2] = {
+        {.fd = socketfd, .events = POLLIN},
+        {.fd = listenfd, .events = POLLIN},
+    };
+    while (poll(fds, 2, -1) >= 0 || errno == EINTR) {
+        // The daemon only writes again once the session is over
+        if (fds[0].revents) break;
+        if (!fds[1].revents) continue;
+
+        int client = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        if (socket_peer_uid(client) == getuid()) {
+            send_fd(control[0], client);
+        } else {
+            ALOGW("rejecting master client from another uid");
+        }
+        close(client);
+    }
+
+    close(listenfd);
+    close(control[0]);
+
+    int code = read_int(socketfd);
+    close(socketfd);
+    ALOGD("master exited %d", code);
+
+    return code;
+}
+
+/*
+ * Attaches our terminal to the su --detach session with the given ID. The
+ * session's host does the relaying itself, we only tell it about window
+ * size changes until the session ends or we are detached.
+ */
+int attach_session(int id) {
+    struct sockaddr_un sun;
+    sigset_t mask, old_mask;
+    int code = EXIT_SUCCESS;
+    int ended = 0;
+
+    int fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        PLOGE("socket");
+        exit(-1);
+    }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_LOCAL;
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + 1 +
+                    snprintf(sun.sun_path + 1, sizeof(sun.sun_path) - 1, SESSION_SOCKET_FORMAT, id);
+    // Anybody can bind an abstract socket, only trust a session hosted by root
+    if (connect(fd, (struct sockaddr*)&sun, len) || socket_peer_uid(fd) != 0) {
+        fprintf(stderr, "No session %d\n", id);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    int sigfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (sigfd < 0) {
+        PLOGE("signalfd");
+        exit(-1);
+    }
+
+    if (isatty(STDIN_FILENO)) set_stdin_raw();
+    if (wire_send_fd(fd, STDIN_FILENO) || wire_send_fd(fd, STDOUT_FILENO)) {
+        restore_stdin();
+        exit(-1);
+    }
+
+    struct pollfd fds[2] = {
+        {.fd = fd, .events = POLLIN},
+        {.fd = sigfd, .events = POLLIN},
+    };
+    while (!ended) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) {
+            struct signalfd_siginfo si;
+            if (read(sigfd, &si, sizeof(si)) != sizeof(si)) continue;
+            if (si.ssi_signo != SIGWINCH) break;
+            char c = SESSION_RESIZE;
+            send(fd, &c, 1, MSG_NOSIGNAL);
+        }
+        if (fds[0].revents) {
+            // The exit code if the session is over, nothing if we were detached
+            ended = recv(fd, &code, sizeof(code), MSG_WAITALL) == sizeof(code);
+            if (!ended) break;
+        }
+    }
+
+    restore_stdin();
+    close(sigfd);
+    close(fd);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (!ended) {
+        fprintf(stderr, "\nDetached from session %d\n", id);
+        code = EXIT_SUCCESS;
+    }
+    return code;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct profile_stage {
+    const char* name;
+    int64_t at;
+};
+
+// Prints the stages of the request in the order they happened in. The
+// clock is the same in every process, but a stage on one side may well be
+// timed after a later one on the other, so they are sorted.
+static void print_profile(const struct client_profile* client, const struct su_profile* daemon) {
+    struct profile_stage stages[] = {
+        {"connected", client->connected},
+        {"acknowledged", client->acknowledged},
+        {"first output", client->first_output},
+        {"finished", client->finished},
+        {"daemon accepted", daemon ? daemon->accepted : 0},
+        {"daemon acknowledged", daemon ? daemon->acknowledged : 0},
+        {"daemon decided", daemon ? daemon->decided : 0},
+        {"daemon executed", daemon ? daemon->executed : 0},
+        {"daemon saw exit", daemon ? daemon->exited : 0},
+    };
+    int n = sizeof(stages) / sizeof(stages[0]);
+    int64_t last = client->start;
+    int i, j;
+
+    // Insertion sort, with the stages never reached at the end
+    for (i = 1; i < n; i++) {
+        struct profile_stage stage = stages[i];
+        for (j = i; j > 0 && stage.at && (!stages[j - 1].at || stages[j - 1].at > stage.at); j--) {
+            stages[j] = stages[j - 1];
+        }
+        stages[j] = stage;
+    }
+
+    fprintf(stderr, "su profile, ms since start and since the previous stage:\n");
+    for (i = 0; i < n; i++) {
+        if (!stages[i].at) {
+            fprintf(stderr, "  %-24s %10s\n", stages[i].name, "-");
+            continue;
+        }
+        fprintf(stderr, "  %-24s %10.3f %+10.3f\n", stages[i].name,
+                (stages[i].at - client->start) / 1e6, (stages[i].at - last) / 1e6);
+        last = stages[i].at;
+    }
+    if (!daemon) fprintf(stderr, "  (no timings from the daemon)\n");
+}
+
+// Prints what the daemon told us about the command, much like time(1)
+static void print_exit_info(const struct su_exit_info* info) {
+    if (!info) {
+        fprintf(stderr, "su time: nothing from the daemon\n");
+        return;
+    }
+    if (info->signal) {
+        fprintf(stderr, "su time: killed by signal %d (%s)%s\n", info->signal,
+                strsignal(info->signal), info->core_dumped ? ", core dumped" : "");
+    } else if (info->status >= 0) {
+        fprintf(stderr, "su time: exited %d\n", info->status);
+    } else {
+        fprintf(stderr, "su time: the daemon lost track of the command\n");
+    }
+    fprintf(stderr, "  real     %10.3f s\n", info->wall_ns / 1e9);
+    fprintf(stderr, "  user     %10.3f s\n", info->utime_us / 1e6);
+    fprintf(stderr, "  sys      %10.3f s\n", info->stime_us / 1e6);
+    fprintf(stderr, "  maxrss   %10lld KiB\n", (long long)info->maxrss_kb);
+    fprintf(stderr, "  switches %10lld voluntary, %lld involuntary\n", (long long)info->nvcsw,
+            (long long)info->nivcsw);
+}
+
+int connect_daemon(int argc, char* argv[], int ppid, const struct su_client_options* opts) {
+    int ptmx = -1;
+    int pts_slave = -1;
+    int recordfd = -1;
+    int id = getpid();
+    struct client_profile profile = {.start = opts->profile ? now_ns() : 0};
+
+    if (opts->record) {
+        // Only output relayed from the PTY is recorded, there would be none
+        if (opts->no_pty || !isatty(STDOUT_FILENO)) {
+            fprintf(stderr, "Cannot record %s: output is not on a terminal\n", opts->record);
+            exit(EXIT_FAILURE);
+        }
+        recordfd = open(opts->record, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (recordfd < 0) {
+            fprintf(stderr, "Cannot write %s: %s\n", opts->record, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Requests go through our uid's master session when one is running
+    trace_begin("connect_daemon", id);
+    int socketfd = attach_master();
+    if (socketfd < 0) {
+        socketfd = open_daemon_socket();
+        if (socketfd < 0) exit(-1);
+    }
+    trace_end();
+    if (opts->profile) profile.connected = now_ns();
+
+    ALOGV("connecting client %d", getpid());
+
+    // Determine which one of our streams are attached to a TTY. Unless we
+    // are told not to, those get a PTY relayed to them.
+    int atty = 0;
+
+    if (!opts->no_pty) {
+        if (isatty(STDIN_FILENO)) atty |= ATTY_IN;
+        if (isatty(STDOUT_FILENO)) atty |= ATTY_OUT;
+        if (isatty(STDERR_FILENO)) atty |= ATTY_ERR;
+    }
+
+    if (atty) {
+        // We need a PTY. Get one.
+        ptmx = pts_open(&pts_slave);
+        if (ptmx < 0) {
+            PLOGE("pts_open");
+            exit(-1);
+        }
+    }
+
+    if (atty & ATTY_OUT) {
+        // Size the PTY before anything runs on it, the relay follows
+        // later changes
+        pts_copy_winsize(STDOUT_FILENO, ptmx);
+    }
+
+    int request_flags =
+        (opts->profile ? SU_REQUEST_PROFILE : 0) | (opts->time ? SU_REQUEST_TIME : 0);
+    if (send_request(socketfd, ppid, request_flags,
+                     (atty & ATTY_IN) ? pts_slave : STDIN_FILENO,
+                     (atty & ATTY_OUT) ? pts_slave : STDOUT_FILENO,
+                     (atty & ATTY_ERR) ? pts_slave : STDERR_FILENO, argc,
+                     (const char* const*)argv)) {
+        request_failed();
+    }
+    if (opts->profile) profile.acknowledged = now_ns();
+    // The daemon has its own copy now. Ours would keep the PTY from
+    // hanging up when the command is done with it.
+    if (pts_slave != -1) close(pts_slave);
+
+    if (atty & (ATTY_IN | ATTY_OUT)) {
+        struct pump_stats stats;
+        int flags = ((atty & ATTY_IN) ? PUMP_STDIN : 0) | ((atty & ATTY_OUT) ? PUMP_STDOUT : 0);
+        if (opts->low_latency) flags |= PUMP_LOW_LATENCY;
+        trace_begin("relay", id);
+        pump_relay(ptmx, socketfd, flags, recordfd, &stats);
+        trace_end();
+        profile.first_output = stats.first_output;
+        ALOGV("relayed %llu bytes in, %llu bytes out in %llu writes",
+              (unsigned long long)stats.bytes_in, (unsigned long long)stats.bytes_out,
+              (unsigned long long)stats.flushes);
+    }
+
+    // Get the exit code
+    trace_begin("wait_exit", id);
+    int code = read_int(socketfd);
+    trace_end();
+    if (opts->profile) profile.finished = now_ns();
+    // Then whatever else we asked for, in the order of struct su_exit_info
+    // and struct su_profile. A daemon which could not fork sends neither.
+    if (opts->time) {
+        struct su_exit_info info;
+        int have = recv(socketfd, &info, sizeof(info), MSG_WAITALL) == sizeof(info);
+        print_exit_info(have ? &info : NULL);
+    }
+    if (opts->profile) {
+        struct su_profile daemon;
+        int have = recv(socketfd, &daemon, sizeof(daemon), MSG_WAITALL) == sizeof(daemon);
+        print_profile(&profile, have ? &daemon : NULL);
+    }
+    close(socketfd);
+    if (ptmx != -1) close(ptmx);
+    if (recordfd != -1) close(recordfd);
+    IF_ALOGD() {
+        ALOGD("client exited %d", code);
+    }
+
+    return code;
+}
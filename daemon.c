@@ -15,7 +15,12 @@
 ** limitations under the License.
 */
 
+#include <malloc.h>
+#include <poll.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -23,185 +28,63 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <cutils/android_filesystem_config.h>
 #include <log/log.h>
 
-#include "pts.h"
+#include "audit.h"
+#include "stats.h"
 #include "su.h"
+#include "trace.h"
 #include "utils.h"
+#include "wire.h"
 
 int is_daemon = 0;
 int daemon_from_uid = 0;
 int daemon_from_pid = 0;
+// The pid of the client, which identifies the request in traces
+int daemon_request_id = 0;
+// When the connection of the request was accepted, and the request acknowledged
+int64_t daemon_accepted_ns = 0;
+int64_t daemon_acknowledged_ns = 0;
+// Where the stages of a SU_REQUEST_PROFILE request are timed, shared with
+// the child serving it. NULL for any other request.
+struct su_profile* daemon_profile = NULL;
+
+// Set while serving requests attached to a su --master session
+int daemon_session = 0;
+unsigned daemon_session_from_uid = 0;
+unsigned daemon_session_to_uid = 0;
+
+// The daemon has nobody to report a broken request to, it just gives up on it
 
-// Constants for the atty bitfield
-#define ATTY_IN 1
-#define ATTY_OUT 2
-#define ATTY_ERR 4
-
-/*
- * Receive a file descriptor from a Unix socket.
- * Contributed by @mkasick
- *
- * Returns the file descriptor on success, or -1 if a file
- * descriptor was not actually included in the message
- *
- * On error the function terminates by calling exit(-1)
- */
 static int recv_fd(int sockfd) {
-    // Need to receive data from the message, otherwise don't care about it.
-    char iovbuf;
-
-    struct iovec iov = {
-        .iov_base = &iovbuf,
-        .iov_len = 1,
-    };
-
-    char cmsgbuf[CMSG_SPACE(sizeof(int))];
-
-    struct msghdr msg = {
-        .msg_iov = &iov,
-        .msg_iovlen = 1,
-        .msg_control = cmsgbuf,
-        .msg_controllen = sizeof(cmsgbuf),
-    };
-
-    if (recvmsg(sockfd, &msg, MSG_WAITALL) != 1) {
-        goto error;
-    }
-
-    // Was a control message actually sent?
-    switch (msg.msg_controllen) {
-        case 0:
-            // No, so the file descriptor was closed and won't be used.
-            return -1;
-        case sizeof(cmsgbuf):
-            // Yes, grab the file descriptor from it.
-            break;
-        default:
-            goto error;
-    }
-
-    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
-
-    if (cmsg == NULL ||
-        cmsg->cmsg_len != CMSG_LEN(sizeof(int)) ||
-        cmsg->cmsg_level != SOL_SOCKET ||
-        cmsg->cmsg_type != SCM_RIGHTS) {
-        goto error;
-    }
-
-    return *(int*)CMSG_DATA(cmsg);
-
-error:
-    ALOGE("unable to read fd");
-    exit(-1);
-}
-
-/*
- * Send a file descriptor through a Unix socket.
- * Contributed by @mkasick
- *
- * On error the function terminates by calling exit(-1)
- *
- * fd may be -1, in which case the dummy data is sent,
- * but no control message with the FD is sent.
- */
-static void send_fd(int sockfd, int fd) {
-    // Need to send some data in the message, this will do.
-    struct iovec iov = {
-        .iov_base = "",
-        .iov_len = 1,
-    };
-
-    struct msghdr msg = {
-        .msg_iov = &iov,
-        .msg_iovlen = 1,
-    };
-
-    char cmsgbuf[CMSG_SPACE(sizeof(int))];
-
-    if (fd != -1) {
-        // Is the file descriptor actually open?
-        if (fcntl(fd, F_GETFD) == -1) {
-            if (errno != EBADF) {
-                goto error;
-            }
-            // It's closed, don't send a control message or sendmsg will EBADF.
-        } else {
-            // It's open, send the file descriptor in a control message.
-            msg.msg_control = cmsgbuf;
-            msg.msg_controllen = sizeof(cmsgbuf);
-
-            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
-            if (!cmsg) {
-                goto error;
-            }
-
-            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
-            cmsg->cmsg_level = SOL_SOCKET;
-            cmsg->cmsg_type = SCM_RIGHTS;
-
-            *(int*)CMSG_DATA(cmsg) = fd;
-        }
-    }
-
-    if (sendmsg(sockfd, &msg, 0) != 1) {
-        goto error;
-    }
-
-    return;
-
-error:
-    PLOGE("unable to send fd");
-    exit(-1);
+    int fd;
+    if (wire_recv_fd(sockfd, &fd)) exit(-1);
+    return fd;
 }
 
 static int read_int(int fd) {
     int val;
-    int len = read(fd, &val, sizeof(int));
-    if (len != sizeof(int)) {
-        ALOGE("unable to read int: %d", len);
-        exit(-1);
-    }
+    if (wire_read_int(fd, &val)) exit(-1);
     return val;
 }
 
 static void write_int(int fd, int val) {
-    int written = write(fd, &val, sizeof(int));
-    if (written != sizeof(int)) {
-        PLOGE("unable to write int");
-        exit(-1);
-    }
+    if (wire_write_int(fd, val)) exit(-1);
 }
 
 static char* read_string(int fd) {
-    int len = read_int(fd);
-    if (len > PATH_MAX || len < 0) {
-        ALOGE("invalid string length %d", len);
-        exit(-1);
-    }
-    char* val = malloc(sizeof(char) * (len + 1));
-    if (val == NULL) {
-        ALOGE("unable to malloc string");
-        exit(-1);
-    }
-    val[len] = '\0';
-    int amount = read(fd, val, len);
-    if (amount != len) {
-        ALOGE("unable to read string");
-        exit(-1);
-    }
+    char* val;
+    if (wire_read_string(fd, &val)) exit(-1);
     return val;
 }
 
-static void write_string(int fd, char* val) {
-    int len = strlen(val);
-    write_int(fd, len);
-    int written = write(fd, val, len);
-    if (written != len) {
-        PLOGE("unable to write string");
-        exit(-1);
-    }
+// Only asked for while tracing, everything else goes by what the client sent
+static int peer_pid(int fd) {
+    struct ucred cred = {.pid = 0};
+    socklen_t len = sizeof(cred);
+    getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len);
+    return cred.pid;
 }
 
 static int run_daemon_child(int infd, int outfd, int errfd, int argc, char** argv) {
@@ -224,18 +107,41 @@ static int run_daemon_child(int infd, int outfd, int errfd, int argc, char** arg
     close(outfd);
     close(errfd);
 
+    trace_end();
     return su_main(argc, argv, 0);
 }
 
 static int daemon_accept(int fd) {
     is_daemon = 1;
+    int version = read_int(fd);
+    if (version != PROTO_VERSION) {
+        // The rest is in a shape we do not know, don't even try to read it
+        ALOGE("rejecting client speaking protocol %d, not %d", version, PROTO_VERSION);
+        write_int(fd, PROTO_VERSION);
+        close(fd);
+        return -1;
+    }
     int pid = read_int(fd);
     int child_result;
-    ALOGD("remote pid: %d", pid);
-    char* pts_slave = read_string(fd);
-    ALOGD("remote pts_slave: %s", pts_slave);
+    daemon_request_id = pid;
+    trace_begin("daemon_accept", pid);
+    IF_ALOGD() {
+        ALOGD("remote pid: %d", pid);
+    }
     daemon_from_pid = read_int(fd);
     ALOGV("remote req pid: %d", daemon_from_pid);
+    int flags = read_int(fd);
+
+    if (flags & SU_REQUEST_PROFILE) {
+        daemon_profile = mmap(NULL, sizeof(*daemon_profile), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (daemon_profile == MAP_FAILED) {
+            PLOGE("mmap profile");
+            daemon_profile = NULL;
+        } else {
+            daemon_profile->accepted = daemon_accepted_ns;
+        }
+    }
 
     struct ucred credentials;
     socklen_t ucred_length = sizeof(struct ucred);
@@ -246,6 +152,10 @@ static int daemon_accept(int fd) {
     }
 
     daemon_from_uid = credentials.uid;
+    stats_add(daemon_from_uid == AID_ROOT    ? STATS_REQUESTS_ROOT
+              : daemon_from_uid == AID_SHELL ? STATS_REQUESTS_SHELL
+                                             : STATS_REQUESTS_APP,
+              1);
 
     // The the FDs for each of the streams
     int infd = recv_fd(fd);
@@ -270,13 +180,22 @@ static int daemon_accept(int fd) {
     }
 
     // ack
-    write_int(fd, 1);
+    write_int(fd, PROTO_VERSION);
+    trace_end();
+    daemon_acknowledged_ns = stats_now_ns();
+    stats_record(STATS_HANDSHAKE, daemon_acknowledged_ns - daemon_accepted_ns);
+    stats_record_rss(STATS_RSS_ACKNOWLEDGED);
+    if (daemon_profile) daemon_profile->acknowledged = daemon_acknowledged_ns;
+    stats_add(STATS_ACTIVE_REQUESTS, 1);
 
     // Fork the child process. The fork has to happen before calling
     // setsid() and opening the pseudo-terminal so that the parent
     // is not affected
+    trace_begin("fork", pid);
+    int64_t forked_ns = (flags & SU_REQUEST_TIME) ? stats_now_ns() : 0;
     int child = fork();
     if (child < 0) {
+        trace_end();
         for (i = 0; i < argc; i++) {
             free(argv[i]);
         }
@@ -284,12 +203,14 @@ static int daemon_accept(int fd) {
 
         // fork failed, send a return code and bail out
         PLOGE("unable to fork");
+        stats_add(STATS_ACTIVE_REQUESTS, -1);
         write(fd, &child, sizeof(int));
         close(fd);
         return child;
     }
 
     if (child != 0) {
+        trace_end();
         for (i = 0; i < argc; i++) {
             free(argv[i]);
         }
@@ -297,16 +218,43 @@ static int daemon_accept(int fd) {
 
         // In parent, wait for the child to exit, and send the exit code
         // across the wire.
+        struct su_exit_info info = {.status = -1};
+        struct rusage usage;
         int code, status;
 
-        free(pts_slave);
+        // Only the child uses the streams. Holding on to a PTY here would
+        // have it hung up rather than closed when the child exits, which
+        // throws away whatever output the client has not read yet.
+        if (infd >= 0) close(infd);
+        if (outfd >= 0) close(outfd);
+        if (errfd >= 0) close(errfd);
 
-        ALOGD("waiting for child exit");
-        if (waitpid(child, &status, 0) > 0) {
-            code = WEXITSTATUS(status);
+        IF_ALOGD() {
+            ALOGD("waiting for child exit");
+        }
+        if (wait4(child, &status, 0, &usage) > 0) {
+            // The child may have exec'd the target directly, so map a
+            // fatal signal the same way allow() does
+            code = WIFSIGNALED(status) ? WTERMSIG(status) + 128 : WEXITSTATUS(status);
+            if (flags & SU_REQUEST_TIME) {
+                info.wall_ns = stats_now_ns() - forked_ns;
+                if (WIFSIGNALED(status)) {
+                    info.signal = WTERMSIG(status);
+                    info.core_dumped = WCOREDUMP(status) != 0;
+                } else {
+                    info.status = WEXITSTATUS(status);
+                }
+                info.utime_us = usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec;
+                info.stime_us = usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec;
+                info.maxrss_kb = usage.ru_maxrss;
+                info.nvcsw = usage.ru_nvcsw;
+                info.nivcsw = usage.ru_nivcsw;
+            }
         } else {
             code = -1;
         }
+        if (daemon_profile) daemon_profile->exited = stats_now_ns();
+        stats_add(STATS_ACTIVE_REQUESTS, -1);
 
         // Is the file descriptor actually open?
         if (fcntl(fd, F_GETFD) == -1) {
@@ -315,18 +263,35 @@ static int daemon_accept(int fd) {
             }
         }
 
-        // Pass the return code back to the client
-        ALOGD("sending code");
-        if (send(fd, &code, sizeof(int), MSG_NOSIGNAL) != sizeof(int)) {
+        // Pass the return code back to the client, followed by what the
+        // command cost and the timings if it asked for them
+        char frame[sizeof(int) + sizeof(struct su_exit_info) + sizeof(struct su_profile)];
+        size_t len = sizeof(int);
+        memcpy(frame, &code, sizeof(int));
+        if (flags & SU_REQUEST_TIME) {
+            memcpy(frame + len, &info, sizeof(info));
+            len += sizeof(info);
+        }
+        if (daemon_profile) {
+            memcpy(frame + len, daemon_profile, sizeof(*daemon_profile));
+            len += sizeof(*daemon_profile);
+        }
+        IF_ALOGD() {
+            ALOGD("sending code");
+        }
+        if (send(fd, frame, len, MSG_NOSIGNAL) != (ssize_t)len) {
             PLOGE("unable to write exit code");
         }
 
         close(fd);
-        ALOGD("child exited");
+        IF_ALOGD() {
+            ALOGD("child exited");
+        }
         return code;
     }
 
-    // We are in the child now
+    // We are in the child now, setting up ends when su_main() takes over
+    trace_begin("child_setup", pid);
     // Close the unix socket file descriptor
     close(fd);
 
@@ -335,51 +300,31 @@ static int daemon_accept(int fd) {
         PLOGE("setsid");
     }
 
-    int ptsfd;
-    if (pts_slave[0]) {
-        // Opening the TTY has to occur after the
-        // fork() and setsid() so that it becomes
-        // our controlling TTY and not the daemon's
-        ptsfd = open(pts_slave, O_RDWR);
-        if (ptsfd == -1) {
-            PLOGE("open(pts_slave) daemon");
-            exit(-1);
-        }
-
-        struct stat st;
-        if (fstat(ptsfd, &st)) {
-            PLOGE("failed to stat pts_slave");
-            exit(-1);
-        }
-
-        if (st.st_uid != credentials.uid) {
-            PLOGE("caller doesn't own proposed PTY");
-            exit(-1);
+    // A stream on a terminal is normally the client's PTY, make it our
+    // controlling TTY now that we lead a session of our own. The client
+    // opened it itself, so nothing needs checking about who owns it.
+    //
+    // With --no-pty it is the caller's own terminal instead, which already
+    // controls the caller's session. Stealing it (TIOCSCTTY with 1) would
+    // leave the caller's shell without one, so the command goes without.
+    int ctty = isatty(infd) ? infd : isatty(outfd) ? outfd : isatty(errfd) ? errfd : -1;
+    if (ctty != -1 && ioctl(ctty, TIOCSCTTY, 0) == -1) {
+        IF_ALOGD() {
+            ALOGD("daemon: running without a controlling TTY");
         }
+    }
 
-        if (!S_ISCHR(st.st_mode)) {
-            PLOGE("proposed PTY isn't a chardev");
+    // Library clients may leave streams closed, give them /dev/null
+    if (infd < 0 || outfd < 0 || errfd < 0) {
+        int null = open("/dev/null", O_RDWR);
+        if (null == -1) {
+            PLOGE("open(/dev/null) daemon");
             exit(-1);
         }
-
-        if (infd < 0) {
-            ALOGD("daemon: stdin using PTY");
-            infd = ptsfd;
-        }
-        if (outfd < 0) {
-            ALOGD("daemon: stdout using PTY");
-            outfd = ptsfd;
-        }
-        if (errfd < 0) {
-            ALOGD("daemon: stderr using PTY");
-            errfd = ptsfd;
-        }
-    } else {
-        // TODO: Check system property, if PTYs are disabled,
-        // made infd the CTTY using:
-        // ioctl(infd, TIOCSCTTY, 1);
+        if (infd < 0) infd = null;
+        if (outfd < 0) outfd = null;
+        if (errfd < 0) errfd = null;
     }
-    free(pts_slave);
 
     child_result = run_daemon_child(infd, outfd, errfd, argc, argv);
     for (i = 0; i < argc; i++) {
@@ -389,6 +334,77 @@ static int daemon_accept(int fd) {
     return child_result;
 }
 
+// Memory pressure the daemon answers by giving memory back: tasks stalled
+// on memory for 150ms in any 2 seconds. Without CAP_SYS_RESOURCE, the
+// window has to be a multiple of 2 seconds.
+#define DAEMON_PSI_PATH "/proc/pressure/memory"
+#define DAEMON_PSI_TRIGGER "some 150000 2000000"
+
+/*
+ * Sets up a trigger for memory pressure, which polls with POLLPRI whenever
+ * it goes off. Kernels without PSI have nothing to poll.
+ *
+ * Returns the file descriptor to poll, or -1.
+ */
+static int open_pressure_trigger(void) {
+    int fd = open(DAEMON_PSI_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGD("no memory pressure triggers: %s", strerror(errno));
+        return -1;
+    }
+    if (write(fd, DAEMON_PSI_TRIGGER, strlen(DAEMON_PSI_TRIGGER) + 1) < 0) {
+        ALOGD("unable to set a memory pressure trigger: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Hands free memory back to the system. Every request forks from us, so
+ * whatever we hold on to would be in each of them as well. The daemon has
+ * no caches, the allocator is all there is to trim.
+ */
+static void trim_memory(void) {
+#ifdef M_PURGE
+    mallopt(M_PURGE, 0);
+#else
+    malloc_trim(0);
+#endif
+    stats_add(STATS_PRESSURE_TRIMS, 1);
+    ALOGD("trimmed memory under pressure");
+}
+
+/*
+ * Waits for a connection on the non-blocking listening socket, trimming
+ * memory whenever the pressure trigger goes off meanwhile. A connection
+ * which is already waiting is taken without polling.
+ *
+ * Returns the accepted socket, or -1 on failure.
+ */
+static int accept_client(int fd, int* psi) {
+    for (;;) {
+        int client = accept4(fd, NULL, NULL, 0);
+        if (client >= 0 || (errno != EAGAIN && errno != EINTR)) return client;
+
+        struct pollfd fds[2] = {
+            {.fd = fd, .events = POLLIN},
+            {.fd = *psi, .events = POLLPRI},
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (fds[1].revents & POLLPRI) {
+            trim_memory();
+        } else if (fds[1].revents & (POLLERR | POLLNVAL)) {
+            // The trigger went away with its cgroup, do without
+            close(*psi);
+            *psi = -1;
+        }
+    }
+}
+
 int run_daemon() {
     if (getuid() != 0 || getgid() != 0) {
         PLOGE("daemon requires root. uid/gid not root");
@@ -438,182 +454,78 @@ int run_daemon() {
         goto err;
     }
 
+    stats_init();
+    audit_init(AUDIT_PATH);
+
+    // Only the listening socket, what it accepts is blocking as ever
+    if (fcntl(fd, F_SETFL, O_NONBLOCK)) {
+        PLOGE("fcntl O_NONBLOCK");
+        goto err;
+    }
+    int psi = open_pressure_trigger();
+
     int client;
-    while ((client = accept(fd, NULL, NULL)) > 0) {
+    while ((client = accept_client(fd, &psi)) > 0) {
+        daemon_accepted_ns = stats_now_ns();
+        trace_begin("fork_zero_fucks",
+                    atrace_is_tag_enabled(SU_TRACE_TAG) ? peer_pid(client) : 0);
         if (fork_zero_fucks() == 0) {
             close(fd);
+            if (psi >= 0) close(psi);
             return daemon_accept(client);
         } else {
+            trace_end();
             close(client);
         }
     }
 
     ALOGE("daemon exiting");
+    if (psi >= 0) close(psi);
 err:
     close(fd);
     return -1;
 }
 
-// List of signals which cause process termination
-static int quit_signals[] = {SIGALRM, SIGHUP, SIGPIPE, SIGQUIT, SIGTERM, SIGINT, 0};
-
-static void sighandler(__attribute__((unused)) int sig) {
-    restore_stdin();
-
-    // Assume we'll only be called before death
-    // See note before sigaction() in set_stdin_raw()
-    //
-    // Now, close all standard I/O to cause the pumps
-    // to exit so we can continue and retrieve the exit
-    // code
-    close(STDIN_FILENO);
-    close(STDOUT_FILENO);
-    close(STDERR_FILENO);
-
-    // Put back all the default handlers
-    struct sigaction act;
-    int i;
-
-    memset(&act, '\0', sizeof(act));
-    act.sa_handler = SIG_DFL;
-    for (i = 0; quit_signals[i]; i++) {
-        if (sigaction(quit_signals[i], &act, NULL) < 0) {
-            PLOGE("Error removing signal handler");
-            continue;
-        }
-    }
-}
-
-/**
- * Setup signal handlers trap signals which should result in program termination
- * so that we can restore the terminal to its normal state and retrieve the
- * return code.
+/*
+ * Serves a su --master session. Runs in the authorized su process, still as
+ * root, and reads client connections which the master forwards over the
+ * control socket. Each one is handled exactly like a connection to the
+ * daemon, but su_main() skips the allow chain for requests from the same
+ * uid to the same target.
+ *
+ * Returns once the master goes away.
  */
-static void setup_sighandlers(void) {
-    struct sigaction act;
-    int i;
-
-    // Install the termination handlers
-    // Note: we're assuming that none of these signal handlers are already trapped.
-    // If they are, we'll need to modify this code to save the previous handler and
-    // call it after we restore stdin to its previous state.
-    memset(&act, '\0', sizeof(act));
-    act.sa_handler = &sighandler;
-    for (i = 0; quit_signals[i]; i++) {
-        if (sigaction(quit_signals[i], &act, NULL) < 0) {
-            PLOGE("Error installing signal handler");
-            continue;
-        }
-    }
-}
-
-int connect_daemon(int argc, char* argv[], int ppid) {
-    int ptmx = -1;
-    char pts_slave[PATH_MAX];
-
-    struct sockaddr_un sun;
-
-    // Open a socket to the daemon
-    int socketfd = socket(AF_LOCAL, SOCK_STREAM, 0);
-    if (socketfd < 0) {
-        PLOGE("socket");
-        exit(-1);
-    }
-    if (fcntl(socketfd, F_SETFD, FD_CLOEXEC)) {
-        PLOGE("fcntl FD_CLOEXEC");
-        exit(-1);
-    }
+int run_master_session(int control, unsigned from_uid, unsigned to_uid) {
+    char c;
 
-    memset(&sun, 0, sizeof(sun));
-    sun.sun_family = AF_LOCAL;
-    sprintf(sun.sun_path, "%s/su-daemon", DAEMON_SOCKET_PATH);
+    daemon_session = 1;
+    daemon_session_from_uid = from_uid;
+    daemon_session_to_uid = to_uid;
 
-    if (0 != connect(socketfd, (struct sockaddr*)&sun, sizeof(sun))) {
-        PLOGE("connect");
-        exit(-1);
+    // Move the control socket out of the way of the stdio descriptors of
+    // the requests we serve
+    control = fcntl(control, F_DUPFD_CLOEXEC, 3);
+    int null = open("/dev/null", O_RDWR);
+    if (control < 0 || null < 0 || dup2(null, STDIN_FILENO) < 0) {
+        PLOGE("master session setup");
+        return EXIT_FAILURE;
     }
+    close(null);
 
-    ALOGV("connecting client %d", getpid());
-
-    // Determine which one of our streams are attached to a TTY
-    int atty = 0;
+    while (recv(control, &c, 1, MSG_PEEK) > 0) {
+        int client = recv_fd(control);
+        if (client < 0) continue;
+        daemon_accepted_ns = stats_now_ns();
 
-    // TODO: Check a system property and never use PTYs if
-    // the property is set.
-    if (isatty(STDIN_FILENO)) atty |= ATTY_IN;
-    if (isatty(STDOUT_FILENO)) atty |= ATTY_OUT;
-    if (isatty(STDERR_FILENO)) atty |= ATTY_ERR;
-
-    if (atty) {
-        // We need a PTY. Get one.
-        ptmx = pts_open(pts_slave, sizeof(pts_slave));
-        if (ptmx < 0) {
-            PLOGE("pts_open");
-            exit(-1);
+        if (fork_zero_fucks() == 0) {
+            close(control);
+            // We already parsed our own options, start su_main() afresh
+            optind = 0;
+            exit(daemon_accept(client));
         }
-    } else {
-        pts_slave[0] = '\0';
-    }
-
-    // Send some info to the daemon, starting with our PID
-    write_int(socketfd, getpid());
-    // Send the slave path to the daemon
-    // (This is "" if we're not using PTYs)
-    write_string(socketfd, pts_slave);
-    // Parent PID
-    write_int(socketfd, ppid);
-
-    // Send stdin
-    if (atty & ATTY_IN) {
-        // Using PTY
-        send_fd(socketfd, -1);
-    } else {
-        send_fd(socketfd, STDIN_FILENO);
-    }
-
-    // Send stdout
-    if (atty & ATTY_OUT) {
-        // Forward SIGWINCH
-        watch_sigwinch_async(STDOUT_FILENO, ptmx);
-
-        // Using PTY
-        send_fd(socketfd, -1);
-    } else {
-        send_fd(socketfd, STDOUT_FILENO);
-    }
-
-    // Send stderr
-    if (atty & ATTY_ERR) {
-        // Using PTY
-        send_fd(socketfd, -1);
-    } else {
-        send_fd(socketfd, STDERR_FILENO);
+        close(client);
     }
 
-    // Number of command line arguments
-    write_int(socketfd, argc);
-
-    // Command line arguments
-    int i;
-    for (i = 0; i < argc; i++) {
-        write_string(socketfd, argv[i]);
-    }
-
-    // Wait for acknowledgement from daemon
-    read_int(socketfd);
-
-    if (atty & ATTY_IN) {
-        setup_sighandlers();
-        pump_stdin_async(ptmx);
-    }
-    if (atty & ATTY_OUT) {
-        pump_stdout_blocking(ptmx);
-    }
-
-    // Get the exit code
-    int code = read_int(socketfd);
-    close(socketfd);
-    ALOGD("client exited %d", code);
-
-    return code;
+    ALOGD("master session for %u->%u ended", from_uid, to_uid);
+    return EXIT_SUCCESS;
 }
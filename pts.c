@@ -23,14 +23,21 @@
 
 #include <errno.h>
 #include <fcntl.h>
-#include <pthread.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/uio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "pts.h"
+#include "record.h"
 
 /**
  * Helper functions
@@ -49,85 +56,308 @@ static int write_blocking(int fd, char* buf, size_t bufsz) {
     return 0;
 }
 
+// Output is written in batches, which start at PUMP_MIN_SIZE and double
+// up to PUMP_MAX_SIZE for as long as each batch fills up
+#define PUMP_MIN_SIZE 4096
+#define PUMP_MAX_SIZE (256 * 1024)
+
+// How long a small batch may wait for more output to go out along with it
+#define PUMP_FLUSH_DELAY_NS (2 * 1000 * 1000)
+
+// Output this soon after a keystroke is likely its echo, and never held
+#define PUMP_ECHO_WINDOW_NS (100 * 1000 * 1000)
+
+// Once the command has exited, the output it left behind is relayed until
+// the PTY goes quiet for PUMP_EXIT_QUIET_NS, and for PUMP_EXIT_DRAIN_NS at
+// most. Anything that still holds the PTY open is not waited for.
+#define PUMP_EXIT_QUIET_NS (10 * 1000 * 1000)
+#define PUMP_EXIT_DRAIN_NS (200 * 1000 * 1000)
+
+// The capacity of a pipe, unless it is changed
+#define PUMP_PIPE_SIZE 65536
+
 /**
- * Pump data from input FD to output FD. If close_output is
- * true, then close the output FD when we're done.
+ * One direction of the relay. Data is moved with splice() through
+ * a pipe, so that it is never copied through user space, until the
+ * kernel refuses to splice between the two FDs. From then on it is
+ * copied through buf.
+ *
+ * Either way, what has been read is held back as the pending batch
+ * until pump_flush() writes it out.
+ *
+ * If record is not -1, every batch is also appended to it as a frame
+ * of a recording. While splicing, the batch is tee()d into recpipe,
+ * which is then spliced to the recording, so it is not copied either.
  */
-static void pump_ex(int input, int output, int close_output) {
-    char buf[4096];
-    int len;
-    while ((len = read(input, buf, 4096)) > 0) {
-        if (write_blocking(output, buf, len) == -1) break;
+struct pump {
+    int input;
+    int output;
+    int pipefd[2];
+    char* buf;
+    size_t size;
+    size_t pending;
+    struct pump_stats* stats;
+    int record;
+    int recpipe[2];
+    int64_t record_start;
+};
+
+static void pump_init(struct pump* p, int input, int output, struct pump_stats* stats) {
+    p->input = input;
+    p->output = output;
+    p->buf = NULL;
+    p->size = PUMP_MIN_SIZE;
+    p->pending = 0;
+    p->stats = stats;
+    p->record = -1;
+    p->recpipe[0] = p->recpipe[1] = -1;
+    if (pipe2(p->pipefd, O_CLOEXEC) == -1) {
+        p->pipefd[0] = p->pipefd[1] = -1;
+        p->buf = malloc(p->size);
+    }
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void pump_stop_recording(struct pump* p) {
+    if (p->recpipe[0] != -1) {
+        close(p->recpipe[0]);
+        close(p->recpipe[1]);
+    }
+    p->recpipe[0] = p->recpipe[1] = -1;
+    p->record = -1;
+}
+
+// Starts a recording on fd with its header
+static void pump_start_recording(struct pump* p, int fd) {
+    struct record_header header = {
+        .magic = RECORD_MAGIC,
+        .version = RECORD_VERSION,
+        .start = time(NULL),
+    };
+
+    if (write_blocking(fd, (char*)&header, sizeof(header)) == -1) return;
+    p->record = fd;
+    p->record_start = now_ns();
+    // Without a pipe of its own, the recording is copied from buf
+    if (p->pipefd[0] != -1 && pipe2(p->recpipe, O_CLOEXEC) == -1) {
+        p->recpipe[0] = p->recpipe[1] = -1;
     }
-    close(input);
-    if (close_output) close(output);
 }
 
 /**
- * Pump data from input FD to output FD. Will close the
- * output FD when done.
+ * Appends the pending batch to the recording. Failing to record never
+ * holds up the relay, the recording just stops.
  */
-static void pump(int input, int output) {
-    pump_ex(input, output, 1);
+static void pump_record(struct pump* p) {
+    struct record_frame frame = {
+        .time = (now_ns() - p->record_start) / 1000000,
+        .len = p->pending,
+    };
+    ssize_t ret;
+
+    if (p->pipefd[0] == -1 || p->recpipe[0] == -1) {
+        // buf only holds the batch once we copy
+        if (p->pipefd[0] != -1 || !p->buf) {
+            pump_stop_recording(p);
+            return;
+        }
+        struct iovec iov[2] = {
+            {.iov_base = &frame, .iov_len = sizeof(frame)},
+            {.iov_base = p->buf, .iov_len = p->pending},
+        };
+        if (writev(p->record, iov, 2) != (ssize_t)(sizeof(frame) + p->pending)) {
+            pump_stop_recording(p);
+        }
+        return;
+    }
+
+    // recpipe can always take a whole batch, pump_grow() sees to that
+    ret = tee(p->pipefd[0], p->recpipe[1], p->pending, 0);
+    if (ret <= 0) {
+        pump_stop_recording(p);
+        return;
+    }
+    frame.len = ret;
+    if (write_blocking(p->record, (char*)&frame, sizeof(frame)) == -1) {
+        pump_stop_recording(p);
+        return;
+    }
+    while (ret > 0) {
+        ssize_t len = splice(p->recpipe[0], NULL, p->record, NULL, ret, SPLICE_F_MOVE);
+        if (len == -1 && errno == EINTR) continue;
+        if (len <= 0) {
+            pump_stop_recording(p);
+            return;
+        }
+        ret -= len;
+    }
 }
 
-static void* pump_thread(void* data) {
-    int* files = (int*)data;
-    int input = files[0];
-    int output = files[1];
-    pump(input, output);
-    free(data);
-    return NULL;
+static void pump_stop_splicing(struct pump* p) {
+    close(p->pipefd[0]);
+    close(p->pipefd[1]);
+    p->pipefd[0] = p->pipefd[1] = -1;
 }
 
-static void pump_async(int input, int output) {
-    pthread_t writer;
-    int* files = (int*)malloc(sizeof(int) * 2);
-    if (files == NULL) {
-        exit(-1);
+static void pump_free(struct pump* p) {
+    if (p->pipefd[0] != -1) pump_stop_splicing(p);
+    pump_stop_recording(p);
+    free(p->buf);
+}
+
+// Switches to copying, once anything left in the pipe has been moved to buf
+static int pump_start_copying(struct pump* p) {
+    size_t len = 0;
+    ssize_t ret;
+
+    p->buf = malloc(p->size);
+    if (!p->buf) return -1;
+    while (len < p->pending) {
+        ret = read(p->pipefd[0], p->buf + len, p->pending - len);
+        if (ret <= 0) return -1;
+        len += ret;
+    }
+    pump_stop_splicing(p);
+    return 0;
+}
+
+// Doubles the batch size, within what the pipe or buf can hold
+static void pump_grow(struct pump* p) {
+    size_t size = p->size * 2;
+
+    if (size > PUMP_MAX_SIZE) return;
+    if (p->pipefd[0] != -1) {
+        // Short reads take up a page of the pipe each, so leave room for them
+        if (size * 2 > PUMP_PIPE_SIZE && fcntl(p->pipefd[1], F_SETPIPE_SZ, size * 2) == -1) {
+            return;
+        }
+        if (size * 2 > PUMP_PIPE_SIZE && p->recpipe[1] != -1 &&
+            fcntl(p->recpipe[1], F_SETPIPE_SZ, size * 2) == -1) {
+            pump_stop_recording(p);
+        }
+    } else {
+        char* buf = realloc(p->buf, size);
+        if (!buf) return;
+        p->buf = buf;
+    }
+    p->size = size;
+}
+
+/**
+ * Adds whatever the (non-blocking) input has available to the pending
+ * batch. A PTY hands out at most 4 KiB per read, so this reads until
+ * the input runs dry or the batch is full.
+ *
+ * Returns 1 if data was read, 0 if none was available, and -1 once
+ * the input is exhausted.
+ */
+static int pump_fill(struct pump* p) {
+    ssize_t len;
+    int ret = 0;
+
+    while (p->pending < p->size) {
+        if (p->pipefd[0] != -1) {
+            len = splice(p->input, NULL, p->pipefd[1], NULL, p->size - p->pending,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (len == -1 && errno == EINVAL) {
+                if (pump_start_copying(p) == -1) return -1;
+                continue;
+            }
+        } else {
+            if (!p->buf) return -1;
+            len = read(p->input, p->buf + p->pending, p->size - p->pending);
+        }
+        if (len == -1 && errno == EINTR) continue;
+        // A full pipe says EAGAIN too, and is as good as a full batch
+        if (len == -1 && errno == EAGAIN) break;
+        if (len <= 0) return -1;
+        p->pending += len;
+        ret = 1;
+    }
+    return ret;
+}
+
+/**
+ * Writes the pending batch to the output, blocking until it has all
+ * been written.
+ *
+ * Returns 0 on success, or -1 if the output fails.
+ */
+static int pump_flush(struct pump* p) {
+    ssize_t ret;
+
+    if (!p->pending) return 0;
+    if (p->stats) {
+        p->stats->bytes_out += p->pending;
+        p->stats->flushes++;
+    }
+    if (p->record != -1) pump_record(p);
+
+    while (p->pending && p->pipefd[0] != -1) {
+        ret = splice(p->pipefd[0], NULL, p->output, NULL, p->pending, SPLICE_F_MOVE);
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret == -1 && errno == EINVAL) {
+            // Flush what is stuck in the pipe the slow way
+            if (pump_start_copying(p) == -1) return -1;
+            break;
+        }
+        if (ret <= 0) return -1;
+        p->pending -= ret;
+    }
+    if (p->pending) {
+        if (write_blocking(p->output, p->buf, p->pending) == -1) return -1;
+        p->pending = 0;
     }
-    files[0] = input;
-    files[1] = output;
-    pthread_create(&writer, NULL, pump_thread, files);
+    return 0;
 }
 
 /**
  * pts_open
  *
- * Opens a pts device and returns the name of the slave tty device.
+ * Opens a pts device and the slave tty device at its other end.
  *
  * Arguments
- * slave_name       the name of the slave device
- * slave_name_size  the size of the buffer passed via slave_name
+ * slave    where the file descriptor of the slave device is stored
+ *
+ * Both file descriptors are close-on-exec, and the slave does not
+ * become our controlling tty.
  *
  * Return Values
- * on failure either -2 or -1 (errno set) is returned.
+ * on failure, -1 and errno is set.
  * on success, the file descriptor of the master device is returned.
  */
-int pts_open(char* slave_name, size_t slave_name_size) {
+int pts_open(int* slave) {
     int fdm;
-    char sn_tmp[slave_name_size];
 
     // Open master ptmx device
-    fdm = open("/dev/ptmx", O_RDWR);
+    fdm = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
     if (fdm == -1) return -1;
 
-    // Get the slave name
-    if (ptsname_r(fdm, sn_tmp, slave_name_size) != 0) {
+    // Grant, then unlock
+    if (grantpt(fdm) == -1 || unlockpt(fdm) == -1) {
         close(fdm);
-        return -2;
-    }
-
-    if (strlcpy(slave_name, sn_tmp, slave_name_size) >= slave_name_size) {
         return -1;
     }
 
-    // Grant, then unlock
-    if (grantpt(fdm) == -1) {
+#ifdef TIOCGPTPEER
+    // Open the slave without looking up its path
+    *slave = ioctl(fdm, TIOCGPTPEER, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (*slave != -1) return fdm;
+#endif
+
+    // Kernels before 4.13 only have the slave's path
+    char slave_name[PATH_MAX];
+    if (ptsname_r(fdm, slave_name, sizeof(slave_name)) != 0) {
         close(fdm);
         return -1;
     }
-    if (unlockpt(fdm) == -1) {
+    *slave = open(slave_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (*slave == -1) {
         close(fdm);
         return -1;
     }
@@ -202,134 +432,209 @@ int restore_stdin(void) {
     return 0;
 }
 
-// Flag indicating whether the sigwinch watcher should terminate.
-static volatile int closing_time = 0;
-
 /**
- * Thread process. Wait for a SIGWINCH to be received, then update
- * the terminal size.
+ * Copies the window size of the terminal on from to the one on to.
  */
-static void* watch_sigwinch(void* data) {
-    sigset_t winch;
-    int sig;
-    int master = ((int*)data)[0];
-    int slave = ((int*)data)[1];
-
-    sigemptyset(&winch);
-    sigaddset(&winch, SIGWINCH);
-
-    do {
-        // Wait for a SIGWINCH
-        sigwait(&winch, &sig);
-
-        if (closing_time) break;
-
-        // Get the new terminal size
-        struct winsize w;
-        if (ioctl(master, TIOCGWINSZ, &w) == -1) {
-            continue;
-        }
-
-        // Set the new terminal size
-        ioctl(slave, TIOCSWINSZ, &w);
+int pts_copy_winsize(int from, int to) {
+    struct winsize w;
+    if (ioctl(from, TIOCGWINSZ, &w) == -1) return -1;
+    return ioctl(to, TIOCSWINSZ, &w);
+}
 
-    } while (1);
+// Signals which end the relay, on top of SIGWINCH which resizes the PTY
+static const int relay_quit_signals[] = {SIGALRM, SIGHUP, SIGPIPE, SIGQUIT, SIGTERM, SIGINT, 0};
 
-    free(data);
-    return NULL;
+static int relay_ctl(int epfd, int op, int fd, uint32_t events) {
+    struct epoll_event ev = {
+        .events = events,
+        .data.fd = fd,
+    };
+    return epoll_ctl(epfd, op, fd, &ev);
 }
 
 /**
- * watch_sigwinch_async
+ * pump_relay
  *
- * After calling this function, if the application receives
- * SIGWINCH, the terminal window size will be read from
- * "input" and set on "output".
+ * Relays data between the standard streams and the PTY from a single
+ * thread, resizing the PTY to follow stdout on SIGWINCH.
  *
- * NOTE: This function blocks SIGWINCH and spawns a thread.
- * NOTE 2: This function must be called before any of the
- *         pump functions.
+ * stdin (PUMP_STDIN) is put in raw mode and forwarded to the PTY, and
+ * the PTY is forwarded to stdout (PUMP_STDOUT). The termination signals
+ * and SIGWINCH are blocked and taken from a signalfd while relaying.
  *
- * Arguments
- * master   A file descriptor of the TTY window size to follow
- * slave    A file descriptor of the TTY window size which is
- *          to be set on SIGWINCH
+ * Returns when the remote end of the PTY closes, when stdout fails, when
+ * a termination signal arrives, or when the daemon sends the exit code on
+ * sockfd. In that last case, if stdout is relayed, output still on its
+ * way is drained first, for 200ms at most. stdin settings and the signal
+ * mask are restored before returning.
  *
- * Return Value
- * on failure, -1 and errno will be set. In this case, no
- *      thread has been spawned and SIGWINCH will not be
- *      blocked.
- * on success, 0
+ * If record is not -1, what is relayed to stdout is also recorded to it.
  */
-int watch_sigwinch_async(int master, int slave) {
-    pthread_t watcher;
-    int* files = (int*)malloc(sizeof(int) * 2);
-    if (files == NULL) {
-        return -1;
+void pump_relay(int ptmx, int sockfd, int flags, int record, struct pump_stats* stats) {
+    struct epoll_event events[4];
+    struct pump out;
+    sigset_t mask, old_mask;
+    char inbuf[4096];
+    size_t inlen = 0, inoff = 0;
+    int input_blocked = 0;
+    uint32_t ptmx_events = (flags & PUMP_STDOUT) ? EPOLLIN : 0;
+    int64_t deadline = 0;
+    int64_t last_input = 0;
+    int64_t exit_deadline = 0, quiet_deadline = 0;
+    int done = 0;
+    int i;
+
+    if (stats) memset(stats, 0, sizeof(*stats));
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    for (i = 0; relay_quit_signals[i]; i++) {
+        sigaddset(&mask, relay_quit_signals[i]);
     }
-
-    // Block SIGWINCH so sigwait can later receive it
-    sigset_t winch;
-    sigemptyset(&winch);
-    sigaddset(&winch, SIGWINCH);
-    if (sigprocmask(SIG_BLOCK, &winch, NULL) == -1) {
-        free(files);
-        return -1;
+    if (sigprocmask(SIG_BLOCK, &mask, &old_mask) == -1) return;
+
+    int sigfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (sigfd == -1 || epfd == -1) goto out;
+
+    // We own the PTY master, so it may be non-blocking. stdio is shared
+    // with whoever started us and stays blocking.
+    fcntl(ptmx, F_SETFL, fcntl(ptmx, F_GETFL) | O_NONBLOCK);
+    pump_init(&out, ptmx, STDOUT_FILENO, stats);
+    if (record != -1 && (flags & PUMP_STDOUT)) pump_start_recording(&out, record);
+
+    relay_ctl(epfd, EPOLL_CTL_ADD, sigfd, EPOLLIN);
+    relay_ctl(epfd, EPOLL_CTL_ADD, sockfd, EPOLLIN);
+    // The PTY is always watched so that we notice it hang up
+    relay_ctl(epfd, EPOLL_CTL_ADD, ptmx, ptmx_events);
+    if (flags & PUMP_STDIN) {
+        set_stdin_raw();
+        relay_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, EPOLLIN);
     }
 
-    // Initialize some variables, then start the thread
-    closing_time = 0;
-    files[0] = master;
-    files[1] = slave;
-    int ret = pthread_create(&watcher, NULL, &watch_sigwinch, files);
-    if (ret != 0) {
-        free(files);
-        errno = ret;
-        return -1;
-    }
-
-    // Set the initial terminal size
-    raise(SIGWINCH);
-    return 0;
-}
+    while (!done) {
+        int64_t wake = out.pending ? deadline : 0;
+        if (exit_deadline) {
+            int64_t drained = quiet_deadline < exit_deadline ? quiet_deadline : exit_deadline;
+            if (!wake || drained < wake) wake = drained;
+        }
 
-/**
- * watch_sigwinch_cleanup
- *
- * Cause the SIGWINCH watcher thread to terminate
- */
-void watch_sigwinch_cleanup(void) {
-    closing_time = 1;
-    raise(SIGWINCH);
-}
+        int timeout = -1;
+        if (wake) {
+            int64_t left = wake - now_ns();
+            timeout = left > 0 ? (left + 999999) / 1000000 : 0;
+        }
 
-/**
- * pump_stdin_async
- *
- * Forward data from STDIN to the given FD
- * in a seperate thread
- */
-void pump_stdin_async(int outfd) {
-    // Put stdin into raw mode
-    set_stdin_raw();
+        int n = epoll_wait(epfd, events, 4, timeout);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        // Busy descriptors may keep epoll_wait() from ever timing out, so
+        // a batch held back for a moment is sent when due either way
+        if (out.pending && now_ns() >= deadline && pump_flush(&out) == -1) done = 1;
+        if (exit_deadline) {
+            int64_t now = now_ns();
+            if (now >= quiet_deadline || now >= exit_deadline) done = 1;
+        }
 
-    // Pump data from stdin to the PTY
-    pump_async(STDIN_FILENO, outfd);
-}
+        for (i = 0; i < n && !done; i++) {
+            int fd = events[i].data.fd;
+            uint32_t ev = events[i].events;
+
+            if (fd == sigfd) {
+                struct signalfd_siginfo si;
+                int resize = 0;
+                // Several resizes may be queued up, only the last size matters
+                while (read(sigfd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGWINCH) {
+                        resize = 1;
+                    } else {
+                        done = 1;
+                    }
+                }
+                if (resize && (flags & PUMP_STDOUT)) pts_copy_winsize(STDOUT_FILENO, ptmx);
+            } else if (fd == sockfd) {
+                // The exit code is waiting. Output may still be on its way,
+                // so drain the PTY for a little while if we relay it. The
+                // daemon hangs up right after sending it, so a hangup which
+                // comes with it is no reason to stop early.
+                if (!(flags & PUMP_STDOUT) || !(ev & EPOLLIN)) {
+                    done = 1;
+                } else {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, sockfd, NULL);
+                    exit_deadline = now_ns() + PUMP_EXIT_DRAIN_NS;
+                    quiet_deadline = now_ns() + PUMP_EXIT_QUIET_NS;
+                }
+            } else if (fd == STDIN_FILENO) {
+                ssize_t len = read(STDIN_FILENO, inbuf, sizeof(inbuf));
+                if (len <= 0) {
+                    if (len == -1 && errno == EINTR) continue;
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+                    continue;
+                }
+                inlen = len;
+                inoff = 0;
+            } else if (fd == ptmx) {
+                if ((ev & EPOLLIN) && (flags & PUMP_STDOUT)) {
+                    int had_pending = out.pending != 0;
+                    int ret = pump_fill(&out);
+                    if (ret == 1 && stats && !stats->first_output) {
+                        stats->first_output = now_ns();
+                    }
+                    if (ret == 1 && exit_deadline) {
+                        quiet_deadline = now_ns() + PUMP_EXIT_QUIET_NS;
+                    }
+                    if (ret == -1) {
+                        // The slave may already be gone
+                        done = 1;
+                    } else if (ret == 0 || out.pending == out.size ||
+                               (flags & PUMP_LOW_LATENCY) ||
+                               now_ns() - last_input < PUMP_ECHO_WINDOW_NS) {
+                        // Nothing more fits, so there is no point waiting.
+                        // Nor is there when it answers a keystroke, or when
+                        // we were asked never to wait. Output which keeps
+                        // coming this fast gets to go out in larger batches.
+                        int full = out.pending == out.size;
+                        if (pump_flush(&out) == -1) done = 1;
+                        if (full) pump_grow(&out);
+                    } else if (!had_pending) {
+                        // Give a trickle of output a moment to collect
+                        deadline = now_ns() + PUMP_FLUSH_DELAY_NS;
+                    }
+                } else if (ev & (EPOLLHUP | EPOLLERR)) {
+                    done = 1;
+                }
+            }
+
+            // Forward pending input. While the PTY won't take any more,
+            // wait for it to drain instead of reading stdin.
+            while (inoff < inlen) {
+                ssize_t len = write(ptmx, inbuf + inoff, inlen - inoff);
+                if (len == -1) {
+                    if (errno == EINTR) continue;
+                    if (errno != EAGAIN) done = 1;
+                    break;
+                }
+                inoff += len;
+                last_input = now_ns();
+                if (stats) stats->bytes_in += len;
+            }
+            int blocked = inoff < inlen;
+            if (blocked != input_blocked) {
+                input_blocked = blocked;
+                relay_ctl(epfd, EPOLL_CTL_MOD, ptmx, ptmx_events | (blocked ? EPOLLOUT : 0));
+                relay_ctl(epfd, blocked ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, STDIN_FILENO, EPOLLIN);
+            }
+        }
+    }
 
-/**
- * pump_stdout_blocking
- *
- * Forward data from the FD to STDOUT.
- * Returns when the remote end of the FD closes.
- *
- * Before returning, restores stdin settings.
- */
-void pump_stdout_blocking(int infd) {
-    // Pump data from stdout to PTY
-    pump_ex(infd, STDOUT_FILENO, 0 /* Don't close output when done */);
+    pump_flush(&out);
+    pump_free(&out);
 
-    // Cleanup
+out:
     restore_stdin();
-    watch_sigwinch_cleanup();
+    if (epfd != -1) close(epfd);
+    if (sigfd != -1) close(sigfd);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
 }
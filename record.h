@@ -0,0 +1,46 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * record.h
+ *
+ * Format of the session recordings made by su --record and played back
+ * by su-replay. A recording is a struct record_header, followed by a
+ * struct record_frame and len bytes of output for every batch of output
+ * the session wrote to the terminal. Integers are in the byte order of
+ * the device that made the recording.
+ */
+
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include <stdint.h>
+
+#define RECORD_MAGIC 0x43525553  // "SURC"
+#define RECORD_VERSION 1
+
+struct record_header {
+    uint32_t magic;
+    uint32_t version;
+    int64_t start;  // seconds since the epoch
+};
+
+struct record_frame {
+    uint32_t time;  // milliseconds since the start
+    uint32_t len;
+};
+
+#endif
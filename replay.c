@@ -0,0 +1,134 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * su-replay
+ *
+ * Plays back a session recorded with su --record on the terminal, at the
+ * pace it was recorded at.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "record.h"
+
+// Longer pauses than this are cut short
+#define MAX_PAUSE_MS 2000
+
+static void usage(int status) {
+    FILE* stream = (status == EXIT_SUCCESS) ? stdout : stderr;
+
+    fprintf(stream,
+            "Usage: su-replay [options] FILE\n\n"
+            "Options:\n"
+            "  -d                  dump the output at once, without pauses\n"
+            "  -h                  display this help message and exit\n"
+            "  -i                  list the frames instead of playing them\n"
+            "  -s SPEED            play back SPEED times as fast\n");
+    exit(status);
+}
+
+static void pause_ms(double ms) {
+    if (ms > MAX_PAUSE_MS) ms = MAX_PAUSE_MS;
+    struct timespec ts = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = ((long)ms % 1000) * 1000000,
+    };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+int main(int argc, char* argv[]) {
+    struct record_header header;
+    struct record_frame frame;
+    double speed = 1;
+    int dump = 0, info = 0;
+    uint32_t last = 0;
+    char buf[4096];
+    int c;
+
+    while ((c = getopt(argc, argv, "dhis:")) != -1) {
+        switch (c) {
+            case 'd':
+                dump = 1;
+                break;
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case 'i':
+                info = 1;
+                break;
+            case 's':
+                speed = atof(optarg);
+                if (speed <= 0) usage(2);
+                break;
+            default:
+                usage(2);
+        }
+    }
+    if (optind != argc - 1) usage(2);
+
+    FILE* f = fopen(argv[optind], "re");
+    if (!f) {
+        fprintf(stderr, "Cannot read %s: %s\n", argv[optind], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != RECORD_MAGIC) {
+        fprintf(stderr, "%s is not a su recording\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    if (header.version != RECORD_VERSION) {
+        fprintf(stderr, "%s is a version %u recording, only %d is supported\n", argv[optind],
+                header.version, RECORD_VERSION);
+        return EXIT_FAILURE;
+    }
+
+    if (info) {
+        time_t start = header.start;
+        printf("started %s", ctime(&start));
+    }
+
+    while (fread(&frame, sizeof(frame), 1, f) == 1) {
+        if (info) {
+            printf("%10u.%03u %u bytes\n", frame.time / 1000, frame.time % 1000, frame.len);
+            if (fseek(f, frame.len, SEEK_CUR)) break;
+            continue;
+        }
+
+        if (!dump && frame.time > last) pause_ms((frame.time - last) / speed);
+        last = frame.time;
+
+        while (frame.len) {
+            size_t len = frame.len < sizeof(buf) ? frame.len : sizeof(buf);
+            if (fread(buf, 1, len, f) != len) {
+                fprintf(stderr, "%s is truncated\n", argv[optind]);
+                return EXIT_FAILURE;
+            }
+            fwrite(buf, 1, len, stdout);
+            frame.len -= len;
+        }
+        fflush(stdout);
+    }
+
+    fclose(f);
+    return EXIT_SUCCESS;
+}
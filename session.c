@@ -0,0 +1,379 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * session.c
+ *
+ * Hosts su --detach sessions. The host is a root process which owns the
+ * PTY master of an authorized shell, keeps the latest output in a
+ * scrollback ring, and relays the PTY to whichever client attaches with
+ * su --attach.
+ *
+ * An attaching client sends its stdin and stdout and then stays on the
+ * connection, writing SESSION_RESIZE whenever its window changes. The
+ * host closes the connection to detach it, or sends the exit code of the
+ * shell once the session is over.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "pts.h"
+#include "stats.h"
+#include "su.h"
+#include "wire.h"
+
+// The most output kept for a client which attaches later
+#define SESSION_SCROLLBACK_SIZE (64 * 1024)
+
+// How long a client may keep its output from taking more before it is detached
+#define SESSION_CLIENT_TIMEOUT_MS 1000
+
+struct scrollback {
+    char buf[SESSION_SCROLLBACK_SIZE];
+    size_t start;
+    size_t len;
+};
+
+// The attached client, if fd is not -1
+struct session_client {
+    int fd;
+    int infd;
+    int outfd;
+    // The flags outfd came with, it is non-blocking while attached
+    int outflags;
+};
+
+static int write_fully(int fd, const char* buf, size_t len) {
+    while (len) {
+        ssize_t ret = write(fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/*
+ * Writes to the output of a client, which is non-blocking. A client which
+ * takes nothing for SESSION_CLIENT_TIMEOUT_MS fails it, rather than
+ * holding up the session.
+ */
+static int client_write(int fd, const char* buf, size_t len) {
+    while (len) {
+        ssize_t ret = write(fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) return -1;
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            if (poll(&pfd, 1, SESSION_CLIENT_TIMEOUT_MS) <= 0) return -1;
+            continue;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static void scrollback_add(struct scrollback* sb, const char* data, size_t len) {
+    // Only the tail of a large chunk survives anyway
+    if (len > sizeof(sb->buf)) {
+        data += len - sizeof(sb->buf);
+        len = sizeof(sb->buf);
+    }
+    while (len) {
+        size_t end = (sb->start + sb->len) % sizeof(sb->buf);
+        size_t n = sizeof(sb->buf) - end;
+        if (n > len) n = len;
+        memcpy(sb->buf + end, data, n);
+        sb->len += n;
+        if (sb->len > sizeof(sb->buf)) {
+            sb->start = (sb->start + sb->len - sizeof(sb->buf)) % sizeof(sb->buf);
+            sb->len = sizeof(sb->buf);
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static int scrollback_replay(const struct scrollback* sb, int fd) {
+    size_t first = sizeof(sb->buf) - sb->start;
+    if (first > sb->len) first = sb->len;
+    if (client_write(fd, sb->buf + sb->start, first)) return -1;
+    return client_write(fd, sb->buf, sb->len - first);
+}
+
+// The output of a client is shared with it, so it gets its flags back
+static void client_restore(struct session_client* client) {
+    if (client->outfd >= 0) fcntl(client->outfd, F_SETFL, client->outflags);
+}
+
+static void client_detach(struct session_client* client) {
+    if (client->fd == -1) return;
+    client_restore(client);
+    close(client->fd);
+    if (client->infd >= 0) close(client->infd);
+    if (client->outfd >= 0) close(client->outfd);
+    client->fd = client->infd = client->outfd = -1;
+    ALOGD("session client detached");
+}
+
+static void client_attach(struct session_client* client, int fd, int ptmx,
+                          const struct scrollback* sb) {
+    int infd, outfd;
+
+    if (wire_recv_fd(fd, &infd)) {
+        close(fd);
+        return;
+    }
+    if (wire_recv_fd(fd, &outfd)) {
+        if (infd >= 0) close(infd);
+        close(fd);
+        return;
+    }
+
+    // Only one client at a time, the newest one wins
+    client_detach(client);
+    client->fd = fd;
+    client->infd = infd;
+    client->outfd = outfd;
+    ALOGD("session client attached");
+
+    if (outfd >= 0) {
+        client->outflags = fcntl(outfd, F_GETFL);
+        fcntl(outfd, F_SETFL, client->outflags | O_NONBLOCK);
+        pts_copy_winsize(outfd, ptmx);
+        if (scrollback_replay(sb, outfd)) client_detach(client);
+    }
+}
+
+/*
+ * Relays the PTY to attached clients until the shell is done with it.
+ * Returns the exit code of the shell.
+ */
+static int host_session(int listenfd, int ptmx, pid_t shell, unsigned owner_uid) {
+    static struct scrollback sb;
+    struct session_client client = {.fd = -1, .infd = -1, .outfd = -1};
+    char buf[4096];
+    int status;
+
+    for (;;) {
+        struct pollfd fds[4] = {
+            {.fd = ptmx, .events = POLLIN},
+            {.fd = listenfd, .events = POLLIN},
+            {.fd = client.fd, .events = POLLIN},
+            {.fd = client.infd, .events = POLLIN},
+        };
+        if (poll(fds, 4, -1) < 0) {
+            if (errno == EINTR) continue;
+            PLOGE("poll");
+            break;
+        }
+
+        if (fds[0].revents) {
+            ssize_t len = read(ptmx, buf, sizeof(buf));
+            if (len <= 0) {
+                if (len < 0 && errno == EINTR) continue;
+                // The shell is done with the PTY
+                break;
+            }
+            // A client which cannot keep up is let go, what it missed is
+            // still in the scrollback for when it attaches again
+            scrollback_add(&sb, buf, len);
+            if (client.outfd >= 0 && client_write(client.outfd, buf, len)) {
+                client_detach(&client);
+            }
+        }
+
+        if (fds[1].revents) {
+            int fd = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                struct ucred cred = {.uid = (uid_t)-1};
+                socklen_t len = sizeof(cred);
+                if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) || cred.uid != owner_uid) {
+                    ALOGW("rejecting session client from uid %u", cred.uid);
+                    close(fd);
+                } else {
+                    client_attach(&client, fd, ptmx, &sb);
+                    continue;
+                }
+            }
+        }
+
+        if (client.fd >= 0 && fds[2].revents) {
+            char c;
+            // Anything but a resize request means the client is gone
+            if (recv(client.fd, &c, 1, 0) == 1 && c == SESSION_RESIZE) {
+                if (client.outfd >= 0) pts_copy_winsize(client.outfd, ptmx);
+            } else {
+                client_detach(&client);
+            }
+        }
+
+        if (client.infd >= 0 && fds[3].revents) {
+            // On a terminal this is the same file as the output, and just
+            // as non-blocking
+            ssize_t len = read(client.infd, buf, sizeof(buf));
+            if (len < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+            if (len <= 0) {
+                client_detach(&client);
+                continue;
+            }
+            // The detach key itself never reaches the shell
+            char* detach = memchr(buf, SESSION_DETACH_CHAR, len);
+            if (detach) len = detach - buf;
+            if (len > 0 && write_fully(ptmx, buf, len)) {
+                // The PTY is of no more use. The shell must not outlive it,
+                // as we wait for it next.
+                PLOGE("session write");
+                kill(shell, SIGKILL);
+                break;
+            }
+            if (detach) client_detach(&client);
+        }
+    }
+
+    if (waitpid(shell, &status, 0) != shell) {
+        status = EXIT_FAILURE << 8;
+    }
+    int code = WIFSIGNALED(status) ? WTERMSIG(status) + 128 : WEXITSTATUS(status);
+
+    // Let the attached client finish with the session
+    client_restore(&client);
+    if (client.fd >= 0) wire_write_int(client.fd, code);
+    client_detach(&client);
+    return code;
+}
+
+/*
+ * Starts an su --detach session. Only returns in the shell of the session,
+ * on the session's PTY, so that the caller goes on to execute it. The
+ * calling process prints the ID of the session and exits once it can be
+ * attached to, and the host process stays behind to serve it.
+ */
+void detach_session(unsigned from_uid, const char* packageName) {
+    struct sockaddr_un sun;
+    int sync[2];
+    char ok;
+
+    if (pipe2(sync, O_CLOEXEC)) {
+        PLOGE("pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    pid_t host = fork();
+    if (host < 0) {
+        PLOGE("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (host) {
+        // Only hand out the ID once the session can be attached to
+        close(sync[1]);
+        if (read(sync[0], &ok, 1) != 1) {
+            fprintf(stderr, "Cannot start session\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("%d\n", host);
+        exit(EXIT_SUCCESS);
+    }
+    close(sync[0]);
+
+    if (setsid() == (pid_t)-1) {
+        PLOGE("setsid");
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int slave;
+    int ptmx = pts_open(&slave);
+    if (ptmx < 0) {
+        PLOGE("pts_open");
+        exit(EXIT_FAILURE);
+    }
+    // Start out the size of the terminal we were started from
+    pts_copy_winsize(STDOUT_FILENO, ptmx);
+
+    int listenfd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_LOCAL;
+    // Abstract socket, the leading NUL is part of the name
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + 1 +
+                    snprintf(sun.sun_path + 1, sizeof(sun.sun_path) - 1,
+                             SESSION_SOCKET_FORMAT, getpid());
+    if (listenfd < 0 || bind(listenfd, (struct sockaddr*)&sun, len) || listen(listenfd, 4)) {
+        PLOGE("session socket");
+        exit(EXIT_FAILURE);
+    }
+
+    // Let go of the terminal we were started from. Holding on to it, even
+    // for a moment, would have it hung up rather than closed when the
+    // caller exits, and the ID would be lost along with any other output
+    // still unread.
+    int null = open("/dev/null", O_RDWR);
+    if (null < 0 || dup2(null, STDIN_FILENO) < 0 || dup2(null, STDOUT_FILENO) < 0 ||
+        dup2(null, STDERR_FILENO) < 0) {
+        PLOGE("session host setup");
+        exit(EXIT_FAILURE);
+    }
+    close(null);
+
+    pid_t shell = fork();
+    if (shell < 0) {
+        PLOGE("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (!shell) {
+        close(listenfd);
+        close(ptmx);
+        close(sync[1]);
+        if (setsid() == (pid_t)-1 || ioctl(slave, TIOCSCTTY, 0) == -1 ||
+            dup2(slave, STDIN_FILENO) < 0 || dup2(slave, STDOUT_FILENO) < 0 ||
+            dup2(slave, STDERR_FILENO) < 0) {
+            PLOGE("session shell setup");
+            exit(EXIT_FAILURE);
+        }
+        close(slave);
+        return;
+    }
+    close(slave);
+
+    ALOGD("hosting session %d for uid %u", getpid(), from_uid);
+    write(sync[1], "", 1);
+    close(sync[1]);
+
+    stats_add(STATS_ACTIVE_SESSIONS, 1);
+    int code = host_session(listenfd, ptmx, shell, from_uid);
+    stats_add(STATS_ACTIVE_SESSIONS, -1);
+    ALOGD("session %d ended with %d", getpid(), code);
+    if (packageName) {
+        appops_finish_op_su(from_uid, packageName);
+    }
+    exit(code);
+}
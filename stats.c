@@ -0,0 +1,248 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "stats.h"
+#include "su.h"
+
+static struct su_stats* stats;
+
+static const char* const counter_names[STATS_COUNTERS] = {
+    "requests_root",
+    "requests_shell",
+    "requests_app",
+    "allow_root",
+    "allow_shell",
+    "allow_appops",
+    "allow_master",
+    "deny_unknown_caller",
+    "deny_access_disabled",
+    "deny_appops",
+    "active_requests",
+    "active_sessions",
+    "pressure_trims",
+};
+
+static const char* const hist_names[STATS_HISTS] = {
+    "handshake",        "exec_root",   "exec_shell",  "exec_app", "appops",
+    "rss_acknowledged", "rss_decided", "rss_executed",
+};
+
+static const char* const hist_units[STATS_HISTS] = {
+    "us", "us", "us", "us", "us", "kb", "kb", "kb",
+};
+
+void stats_init(void) {
+    // Anonymous and shared, the processes we fork keep updating the very
+    // same pages and nothing else can get at them
+    struct su_stats* s =
+        mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (s == MAP_FAILED) {
+        PLOGE("mmap stats");
+        return;
+    }
+    s->magic = STATS_MAGIC;
+    s->version = STATS_VERSION;
+    s->start = time(NULL);
+    s->pid = getpid();
+    stats = s;
+}
+
+void stats_add(enum stats_counter counter, int64_t delta) {
+    if (!stats) return;
+    __atomic_fetch_add(&stats->counters[counter], delta, __ATOMIC_RELAXED);
+}
+
+static int bucket_of(uint64_t us) {
+    if (us < STATS_HIST_SUB) return us;
+    int msb = 63 - __builtin_clzll(us);
+    int bucket = (msb - STATS_HIST_SUB_BITS + 1) * STATS_HIST_SUB +
+                 ((us >> (msb - STATS_HIST_SUB_BITS)) & (STATS_HIST_SUB - 1));
+    return bucket < STATS_HIST_BUCKETS ? bucket : STATS_HIST_BUCKETS - 1;
+}
+
+uint64_t stats_bucket_floor(int bucket) {
+    if (bucket < STATS_HIST_SUB) return bucket;
+    int msb = bucket / STATS_HIST_SUB + STATS_HIST_SUB_BITS - 1;
+    return (uint64_t)(STATS_HIST_SUB + bucket % STATS_HIST_SUB) << (msb - STATS_HIST_SUB_BITS);
+}
+
+static void record(enum stats_hist hist, uint64_t value) {
+    struct stats_histogram* h = &stats->hists[hist];
+    __atomic_fetch_add(&h->buckets[bucket_of(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+}
+
+void stats_record(enum stats_hist hist, int64_t ns) {
+    if (!stats) return;
+    record(hist, ns > 0 ? ns / 1000 : 0);
+}
+
+void stats_record_rss(enum stats_hist hist) {
+    struct rusage usage;
+
+    // The high-water mark, which a single syscall gets us, unlike the
+    // current RSS. The fork for the request starts it off at the daemon's.
+    if (!stats || getrusage(RUSAGE_SELF, &usage)) return;
+    record(hist, usage.ru_maxrss);
+}
+
+int64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Sums up the Rss: and Pss: lines of a smaps file
+static int read_smaps(const char* path, int64_t* rss_kb, int64_t* pss_kb) {
+    char line[256];
+    long long kb;
+
+    FILE* f = fopen(path, "re");
+    if (!f) return -1;
+    *rss_kb = *pss_kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Rss: %lld", &kb) == 1) {
+            *rss_kb += kb;
+        } else if (sscanf(line, "Pss: %lld", &kb) == 1) {
+            *pss_kb += kb;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int stats_footprint(pid_t pid, int64_t* rss_kb, int64_t* pss_kb) {
+    char path[64];
+
+    // smaps_rollup has the sums already, kernels before 4.14 only have smaps
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    if (!read_smaps(path, rss_kb, pss_kb)) return 0;
+    snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+    return read_smaps(path, rss_kb, pss_kb);
+}
+
+static void snapshot(struct su_stats* s) {
+    int i, j;
+
+    s->magic = stats->magic;
+    s->version = stats->version;
+    s->start = stats->start;
+    s->pid = stats->pid;
+    s->reserved = 0;
+    if (stats_footprint(s->pid, &s->rss_kb, &s->pss_kb)) {
+        s->rss_kb = s->pss_kb = -1;
+    }
+    for (i = 0; i < STATS_COUNTERS; i++) {
+        s->counters[i] = __atomic_load_n(&stats->counters[i], __ATOMIC_RELAXED);
+    }
+    for (i = 0; i < STATS_HISTS; i++) {
+        struct stats_histogram* h = &stats->hists[i];
+        s->hists[i].count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        s->hists[i].sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+        for (j = 0; j < STATS_HIST_BUCKETS; j++) {
+            s->hists[i].buckets[j] = __atomic_load_n(&h->buckets[j], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// The floor of the bucket holding the given fraction of the samples
+static uint64_t percentile(const struct stats_histogram* h, uint64_t total, int pct) {
+    uint64_t want = (total * pct + 99) / 100, seen = 0;
+    int i;
+
+    for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= want && seen) return stats_bucket_floor(i);
+    }
+    return 0;
+}
+
+static void dump_text(FILE* f, const struct su_stats* s) {
+    int i;
+
+    fprintf(f, "uptime_s %lld\n", (long long)(time(NULL) - s->start));
+    fprintf(f, "daemon_rss_kb %lld\n", (long long)s->rss_kb);
+    fprintf(f, "daemon_pss_kb %lld\n", (long long)s->pss_kb);
+    for (i = 0; i < STATS_COUNTERS; i++) {
+        fprintf(f, "%s %lld\n", counter_names[i], (long long)s->counters[i]);
+    }
+    for (i = 0; i < STATS_HISTS; i++) {
+        const struct stats_histogram* h = &s->hists[i];
+        // The buckets move on while we read, go by their own total
+        uint64_t total = 0;
+        int j;
+        for (j = 0; j < STATS_HIST_BUCKETS; j++) {
+            total += h->buckets[j];
+        }
+        const char* name = hist_names[i];
+        const char* unit = hist_units[i];
+        fprintf(f, "%s_count %llu\n", name, (unsigned long long)h->count);
+        fprintf(f, "%s_mean_%s %llu\n", name, unit,
+                (unsigned long long)(h->count ? h->sum / h->count : 0));
+        fprintf(f, "%s_p50_%s %llu\n", name, unit, (unsigned long long)percentile(h, total, 50));
+        fprintf(f, "%s_p90_%s %llu\n", name, unit, (unsigned long long)percentile(h, total, 90));
+        fprintf(f, "%s_p99_%s %llu\n", name, unit, (unsigned long long)percentile(h, total, 99));
+    }
+}
+
+int stats_dump(int fd, int binary) {
+    struct su_stats* s;
+
+    if (!stats) {
+        fprintf(stderr, "No stats outside of the daemon\n");
+        return -1;
+    }
+    s = malloc(sizeof(*s));
+    if (!s) return -1;
+    snapshot(s);
+
+    int ret = 0;
+    if (binary) {
+        const char* buf = (const char*)s;
+        size_t len = sizeof(*s);
+        while (len) {
+            ssize_t n = write(fd, buf, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ret = -1;
+                break;
+            }
+            buf += n;
+            len -= n;
+        }
+    } else {
+        FILE* f = fdopen(dup(fd), "w");
+        if (f) {
+            dump_text(f, s);
+            if (fclose(f)) ret = -1;
+        } else {
+            ret = -1;
+        }
+    }
+
+    free(s);
+    return ret;
+}
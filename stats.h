@@ -0,0 +1,130 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * stats.h
+ *
+ * Counters and latency histograms kept by the daemon, and read with
+ * su --stats. They live in a shared mapping which the daemon sets up
+ * before it starts accepting, so every process serving a request updates
+ * the same ones, with atomic operations and no locks.
+ *
+ * su --stats=binary writes struct su_stats as it is, which is what
+ * anything parsing them should read. The footprint of the daemon itself is
+ * not kept here, it is read from /proc when the stats are dumped.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define STATS_MAGIC 0x54535553  // "SUST"
+#define STATS_VERSION 2
+
+enum stats_counter {
+    // Requests by caller class
+    STATS_REQUESTS_ROOT,
+    STATS_REQUESTS_SHELL,
+    STATS_REQUESTS_APP,
+    // Outcomes, by the reason for them
+    STATS_ALLOW_ROOT,
+    STATS_ALLOW_SHELL,
+    STATS_ALLOW_APPOPS,
+    STATS_ALLOW_MASTER,
+    STATS_DENY_UNKNOWN_CALLER,
+    STATS_DENY_ACCESS_DISABLED,
+    STATS_DENY_APPOPS,
+    // Gauges, these go up and down
+    STATS_ACTIVE_REQUESTS,
+    STATS_ACTIVE_SESSIONS,
+    // Times the daemon gave memory back under pressure
+    STATS_PRESSURE_TRIMS,
+    STATS_COUNTERS,
+};
+
+enum stats_hist {
+    // From accepting a connection to acknowledging the request
+    STATS_HANDSHAKE,
+    // From accepting a connection to executing the command, by caller class
+    STATS_EXEC_ROOT,
+    STATS_EXEC_SHELL,
+    STATS_EXEC_APP,
+    // Binder calls to AppOpsManager
+    STATS_APPOPS,
+    // The peak RSS of the process serving a request by the time it got to
+    // each stage, in KiB rather than microseconds
+    STATS_RSS_ACKNOWLEDGED,
+    STATS_RSS_DECIDED,
+    STATS_RSS_EXECUTED,
+    STATS_HISTS,
+};
+
+/*
+ * Log-linear histogram of microseconds, or KiB. Each power of two is split
+ * into STATS_HIST_SUB linear buckets, and the last bucket takes everything
+ * from just under 8 minutes (or 469 GiB) on.
+ */
+#define STATS_HIST_SUB_BITS 2
+#define STATS_HIST_SUB (1 << STATS_HIST_SUB_BITS)
+#define STATS_HIST_BUCKETS 112
+
+struct stats_histogram {
+    uint64_t count;
+    uint64_t sum;  // in the unit of the histogram
+    uint64_t buckets[STATS_HIST_BUCKETS];
+};
+
+struct su_stats {
+    uint32_t magic;
+    uint32_t version;
+    int64_t start;  // when the daemon started, seconds since the epoch
+    int32_t pid;    // of the daemon
+    int32_t reserved;
+    int64_t rss_kb;  // of the daemon when dumped, or -1 if it could not be read
+    int64_t pss_kb;
+    int64_t counters[STATS_COUNTERS];
+    struct stats_histogram hists[STATS_HISTS];
+};
+
+/* Sets up the shared counters. Until then, updating them does nothing. */
+void stats_init(void);
+
+void stats_add(enum stats_counter counter, int64_t delta);
+void stats_record(enum stats_hist hist, int64_t ns);
+/* Records the peak RSS of the calling process so far in a STATS_RSS_* one. */
+void stats_record_rss(enum stats_hist hist);
+
+/* For timing what goes into the histograms, in nanoseconds. */
+int64_t stats_now_ns(void);
+
+/* The lowest value, in the unit of the histogram, which falls into the bucket. */
+uint64_t stats_bucket_floor(int bucket);
+
+/*
+ * Reads the RSS and PSS of a process, in KiB. Returns 0 on success, or -1
+ * on failure.
+ */
+int stats_footprint(pid_t pid, int64_t* rss_kb, int64_t* pss_kb);
+
+/*
+ * Writes out a snapshot of the counters, as text or as struct su_stats.
+ * Returns 0 on success, or -1 on failure.
+ */
+int stats_dump(int fd, int binary);
+
+#endif
@@ -16,25 +16,38 @@
 ** limitations under the License.
 */
 
+#include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <pwd.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cutils/android_filesystem_config.h>
 #include <cutils/properties.h>
 #include <log/log.h>
 
+#include "audit.h"
 #include "binder/pm-wrapper.h"
+#include "stats.h"
 #include "su.h"
+#include "trace.h"
 #include "utils.h"
 
 extern int is_daemon;
 extern int daemon_from_uid;
 extern int daemon_from_pid;
+extern int daemon_request_id;
+extern int64_t daemon_accepted_ns;
+extern int64_t daemon_acknowledged_ns;
+extern struct su_profile* daemon_profile;
+extern int daemon_session;
+extern unsigned daemon_session_from_uid;
+extern unsigned daemon_session_to_uid;
 
 int fork_zero_fucks() {
     int pid = fork();
@@ -174,20 +187,77 @@ static void usage(int status) {
     fprintf(stream,
             "Usage: su [options] [--] [-] [LOGIN] [--] [args...]\n\n"
             "Options:\n"
+            "  --attach ID                   reconnect to a session started with\n"
+            "                                --detach, Ctrl-\\ detaches again\n"
+            "  --batch FILE                  run each line of FILE (- for stdin) as a\n"
+            "                                command, tagging output with its line id\n"
             "  --daemon                      start the su daemon agent\n"
+            "  --detach                      start the session in the background\n"
+            "                                and print its ID\n"
             "  -c, --command COMMAND         pass COMMAND to the invoked shell\n"
             "  -h, --help                    display this help message and exit\n"
+            "  --jobs N                      run up to N --batch commands at once\n"
             "  -, -l, --login                pretend the shell to be a login shell\n"
+            "  --low-latency                 relay every bit of terminal output at\n"
+            "                                once, at some cost in CPU\n"
+            "  --master                      keep an authorized session open which\n"
+            "                                later su calls from this user attach to\n"
+            "  --no-pty                      never put the command on a pseudo-terminal,\n"
+            "                                it gets our stdin, stdout and stderr as\n"
+            "                                they are. persist.sys.su.no_pty makes this\n"
+            "                                the default\n"
             "  -m, -p,\n"
             "  --preserve-environment        do not change environment variables\n"
+            "  --profile                     print how long each stage of the request\n"
+            "                                took once it is done\n"
             "  -s, --shell SHELL             use SHELL instead of the default " DEFAULT_SHELL
             "\n"
+            "  --read PATH                   print the contents of PATH\n"
+            "  --record FILE                 record what the session prints on the\n"
+            "                                terminal to FILE, see su-replay. Writing\n"
+            "                                FILE costs 10-30%% more CPU per MiB of\n"
+            "                                output\n"
+            "  --stats[=FORMAT]              print the counters of the su daemon, as\n"
+            "                                text (the default) or binary\n"
+            "  --time                        print how the command ended, how long it\n"
+            "                                took and the resources it used\n"
+            "  --write PATH VALUE            write VALUE to PATH, --read and --write\n"
+            "                                may be repeated and run in order without\n"
+            "                                spawning a shell\n"
             "  -v, --version                 display version number and exit\n"
             "  -V                            display version code and exit,\n"
             "                                this is used almost exclusively by Superuser.apk\n");
     exit(status);
 }
 
+/*
+ * Accounts for the outcome of a request, in the stats, the audit log and
+ * the profile if one was asked for.
+ */
+static void decided(const struct su_context* ctx, enum stats_counter counter,
+                    enum audit_outcome outcome) {
+    int64_t now = stats_now_ns();
+    struct timespec ts;
+
+    stats_add(counter, 1);
+    stats_record_rss(STATS_RSS_DECIDED);
+    if (daemon_profile) daemon_profile->decided = now;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    struct audit_record record = {
+        .time = ts.tv_sec * 1000000000LL + ts.tv_nsec,
+        .from_uid = ctx->from.uid,
+        .to_uid = ctx->to.uid,
+        .from_pid = ctx->from.pid,
+        .client_pid = daemon_request_id,
+        .command_hash = audit_hash(ctx->to.argc, ctx->to.argv),
+        .outcome = outcome,
+        .handshake_us = (daemon_acknowledged_ns - daemon_accepted_ns) / 1000,
+        .decision_us = (now - daemon_accepted_ns) / 1000,
+    };
+    audit_write(&record);
+}
+
 static __attribute__((noreturn)) void deny(struct su_context* ctx) {
     char* cmd = get_command(&ctx->to);
     ALOGW("request rejected (%u->%u %s)", ctx->from.uid, ctx->to.uid, cmd);
@@ -195,10 +265,77 @@ static __attribute__((noreturn)) void deny(struct su_context* ctx) {
     exit(EXIT_FAILURE);
 }
 
+static int write_fully(int fd, const char* buf, size_t len) {
+    while (len) {
+        ssize_t ret = write(fd, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/*
+ * Runs the --read/--write built-ins in order as the target identity,
+ * without spawning a shell. Returns the exit code for the request.
+ */
+static int run_fileops(const struct su_context* ctx) {
+    char buf[4096];
+    int code = EXIT_SUCCESS;
+    int i;
+
+    for (i = 0; i < ctx->to.nfileops; i++) {
+        const struct su_fileop* op = &ctx->to.fileops[i];
+        ssize_t len;
+        int fd;
+
+        IF_ALOGD() {
+            ALOGD("%u %s %s %u %s", ctx->from.uid, ctx->from.bin,
+                  op->value ? "writing" : "reading", ctx->to.uid, op->path);
+        }
+
+        if (op->value) {
+            fd = open(op->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+            if (fd < 0 || write_fully(fd, op->value, strlen(op->value))) {
+                fprintf(stderr, "Cannot write %s: %s\n", op->path, strerror(errno));
+                code = EXIT_FAILURE;
+            }
+        } else {
+            fd = open(op->path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                fprintf(stderr, "Cannot read %s: %s\n", op->path, strerror(errno));
+                code = EXIT_FAILURE;
+            }
+            while (fd >= 0 && (len = read(fd, buf, sizeof(buf))) != 0) {
+                if (len < 0 && errno == EINTR) continue;
+                if (len < 0) {
+                    fprintf(stderr, "Cannot read %s: %s\n", op->path, strerror(errno));
+                    code = EXIT_FAILURE;
+                    break;
+                }
+                if (write_fully(STDOUT_FILENO, buf, len)) {
+                    // Our output is the problem, not the file
+                    fprintf(stderr, "Cannot write %s to stdout: %s\n", op->path,
+                            strerror(errno));
+                    code = EXIT_FAILURE;
+                    break;
+                }
+            }
+        }
+        if (fd >= 0) close(fd);
+    }
+
+    return code;
+}
+
 static __attribute__((noreturn)) void allow(struct su_context* ctx, const char* packageName) {
     char* arg0;
     int argc, err;
 
+    trace_begin("allow", daemon_request_id);
     umask(ctx->umask);
 
     char* binary;
@@ -231,20 +368,88 @@ static __attribute__((noreturn)) void allow(struct su_context* ctx, const char*
     }
 
     populate_environment(ctx);
+
+    if (ctx->to.detach) {
+        // We come back as the session's shell, the host finishes the
+        // appops operation when the shell exits. The shell is a process of
+        // its own, so it begins a span of its own for the rest.
+        trace_end();
+        detach_session(ctx->from.uid, packageName);
+        trace_begin("allow", daemon_request_id);
+        packageName = NULL;
+    }
+
+    if (ctx->to.master) {
+        // The session stays root so it can take on the target identity in
+        // each of the requests it serves
+        trace_end();
+        int code = run_master_session(STDIN_FILENO, ctx->from.uid, ctx->to.uid);
+        if (packageName) {
+            appops_finish_op_su(ctx->from.uid, packageName);
+        }
+        exit(code);
+    }
+
+    if (ctx->to.stats) {
+        // Still root, or the footprint of the daemon could not be read
+        trace_end();
+        int code = stats_dump(STDOUT_FILENO, ctx->to.stats == SU_STATS_BINARY) ? EXIT_FAILURE
+                                                                                : EXIT_SUCCESS;
+        if (packageName) {
+            appops_finish_op_su(ctx->from.uid, packageName);
+        }
+        exit(code);
+    }
+
     set_identity(ctx->to.uid);
 
+    if (ctx->to.nfileops) {
+        trace_end();
+        int code = run_fileops(ctx);
+        if (packageName) {
+            appops_finish_op_su(ctx->from.uid, packageName);
+        }
+        exit(code);
+    }
+
+    if (ctx->to.batch) {
+        trace_end();
+        int code = run_batch(ctx);
+        if (packageName) {
+            appops_finish_op_su(ctx->from.uid, packageName);
+        }
+        exit(code);
+    }
+
 #define PARG(arg)                             \
     (argc + (arg) < ctx->to.argc) ? " " : "", \
         (argc + (arg) < ctx->to.argc) ? ctx->to.argv[argc + (arg)] : ""
 
-    ALOGD("%u %s executing %u %s using binary %s : %s%s%s%s%s%s%s%s%s%s%s%s%s%s", ctx->from.uid,
-          ctx->from.bin, ctx->to.uid, get_command(&ctx->to), binary, arg0, PARG(0), PARG(1),
-          PARG(2), PARG(3), PARG(4), PARG(5), (ctx->to.optind + 6 < ctx->to.argc) ? " ..." : "");
+    // The audit log has the request already, this is for debugging only
+    IF_ALOGD() {
+        ALOGD("%u %s executing %u %s using binary %s : %s%s%s%s%s%s%s%s%s%s%s%s%s%s",
+              ctx->from.uid, ctx->from.bin, ctx->to.uid, get_command(&ctx->to), binary, arg0,
+              PARG(0), PARG(1), PARG(2), PARG(3), PARG(4), PARG(5),
+              (ctx->to.optind + 6 < ctx->to.argc) ? " ..." : "");
+    }
 
     ctx->to.argv[--argc] = arg0;
 
-    int pid = fork();
+    int64_t executed = stats_now_ns();
+    stats_record(ctx->from.uid == AID_ROOT    ? STATS_EXEC_ROOT
+                 : ctx->from.uid == AID_SHELL ? STATS_EXEC_SHELL
+                                              : STATS_EXEC_APP,
+                 executed - daemon_accepted_ns);
+    stats_record_rss(STATS_RSS_EXECUTED);
+    if (daemon_profile) daemon_profile->executed = executed;
+
+    // Without an appops operation to finish there is nothing left for us to
+    // do once the target runs, so replace ourselves with it instead of paying
+    // for another fork. The daemon reaps it and reports the exit status.
+    int pid = packageName ? fork() : 0;
     if (!pid) {
+        // A forked child has no span of its own to end
+        if (!packageName) trace_end();
         execvp(binary, ctx->to.argv + argc);
         err = errno;
         PLOGE("exec");
@@ -253,9 +458,14 @@ static __attribute__((noreturn)) void allow(struct su_context* ctx, const char*
     } else {
         int status, code;
 
-        ALOGD("Waiting for pid %d.", pid);
+        trace_end();
+        IF_ALOGD() {
+            ALOGD("Waiting for pid %d.", pid);
+        }
         waitpid(pid, &status, 0);
-        ALOGD("pid %d returned %d.", pid, status);
+        IF_ALOGD() {
+            ALOGD("pid %d returned %d.", pid, status);
+        }
         code = WIFSIGNALED(status) ? WTERMSIG(status) + 128 : WEXITSTATUS(status);
 
         if (packageName) {
@@ -361,7 +571,9 @@ int su_main(int argc, char* argv[], int need_client) {
         cp++;
     }
 
-    ALOGD("su invoked.");
+    IF_ALOGD() {
+        ALOGD("su invoked.");
+    }
 
     struct su_context ctx = {
         .from =
@@ -383,21 +595,71 @@ int su_main(int argc, char* argv[], int need_client) {
                 .argc = argc,
                 .optind = 0,
                 .name = "",
+                .fileops = NULL,
+                .nfileops = 0,
+                .batch = NULL,
+                .jobs = 0,
+                .master = 0,
+                .detach = 0,
+                .stats = 0,
             },
     };
+    struct su_client_options client_opts = {
+        .record = NULL,
+        .low_latency = 0,
+        .no_pty = property_get_bool("persist.sys.su.no_pty", false),
+        .profile = 0,
+        .time = 0,
+    };
+    int attach = -1;
     int c;
     struct option long_opts[] = {
+        {"attach", required_argument, NULL, 'A'},
+        {"batch", required_argument, NULL, 'B'},
         {"command", required_argument, NULL, 'c'},
+        {"detach", no_argument, NULL, 'D'},
         {"help", no_argument, NULL, 'h'},
+        {"jobs", required_argument, NULL, 'J'},
         {"login", no_argument, NULL, 'l'},
+        {"low-latency", no_argument, NULL, 'L'},
+        {"master", no_argument, NULL, 'M'},
+        {"no-pty", no_argument, NULL, 'N'},
         {"preserve-environment", no_argument, NULL, 'p'},
+        {"profile", no_argument, NULL, 'P'},
+        {"read", required_argument, NULL, 'R'},
+        {"record", required_argument, NULL, 'O'},
         {"shell", required_argument, NULL, 's'},
+        {"stats", optional_argument, NULL, 'S'},
+        {"time", no_argument, NULL, 'T'},
         {"version", no_argument, NULL, 'v'},
+        {"write", required_argument, NULL, 'W'},
         {NULL, 0, NULL, 0},
     };
 
     while ((c = getopt_long(argc, argv, "+c:hlmps:Vv", long_opts, NULL)) != -1) {
         switch (c) {
+            case 'A':
+                attach = atoi(optarg);
+                break;
+            case 'B':
+                ctx.to.batch = optarg;
+                break;
+            case 'D':
+                ctx.to.detach = 1;
+                break;
+            case 'J': {
+                char* endptr;
+                long jobs;
+
+                errno = 0;
+                jobs = strtol(optarg, &endptr, 10);
+                if (errno || endptr == optarg || *endptr || jobs <= 0 || jobs > INT_MAX) {
+                    fprintf(stderr, "Invalid number of jobs: %s\n", optarg);
+                    usage(2);
+                }
+                ctx.to.jobs = jobs;
+                break;
+            }
             case 'c':
                 ctx.to.shell = DEFAULT_SHELL;
                 ctx.to.command = optarg;
@@ -408,6 +670,25 @@ int su_main(int argc, char* argv[], int need_client) {
             case 'l':
                 ctx.to.login = 1;
                 break;
+            case 'M':
+                ctx.to.master = 1;
+                break;
+            case 'L':
+                client_opts.low_latency = 1;
+                break;
+            case 'N':
+                client_opts.no_pty = 1;
+                break;
+            case 'P':
+                client_opts.profile = 1;
+                break;
+            case 'T':
+                client_opts.time = 1;
+                break;
+            case 'O':
+                // Only the client relays the terminal, the daemon ignores it
+                client_opts.record = optarg;
+                break;
             case 'm':
             case 'p':
                 ctx.to.keepenv = 1;
@@ -415,6 +696,34 @@ int su_main(int argc, char* argv[], int need_client) {
             case 's':
                 ctx.to.shell = optarg;
                 break;
+            case 'S':
+                if (!optarg || !strcmp(optarg, "text")) {
+                    ctx.to.stats = SU_STATS_TEXT;
+                } else if (!strcmp(optarg, "binary")) {
+                    ctx.to.stats = SU_STATS_BINARY;
+                } else {
+                    usage(2);
+                }
+                break;
+            case 'R':
+            case 'W':
+                if (!ctx.to.fileops) {
+                    // There can never be more operations than arguments
+                    ctx.to.fileops = malloc(sizeof(struct su_fileop) * argc);
+                    if (!ctx.to.fileops) exit(EXIT_FAILURE);
+                }
+                ctx.to.fileops[ctx.to.nfileops].path = optarg;
+                ctx.to.fileops[ctx.to.nfileops].value = NULL;
+                if (c == 'W') {
+                    // --write takes the value as the following argument
+                    if (optind >= argc) {
+                        fprintf(stderr, "--write requires a PATH and a VALUE\n");
+                        usage(2);
+                    }
+                    ctx.to.fileops[ctx.to.nfileops].value = argv[optind++];
+                }
+                ctx.to.nfileops++;
+                break;
             case 'V':
                 printf("%d\n", VERSION_CODE);
                 exit(EXIT_SUCCESS);
@@ -428,10 +737,35 @@ int su_main(int argc, char* argv[], int need_client) {
         }
     }
 
+    if ((ctx.to.nfileops || ctx.to.batch || ctx.to.master || ctx.to.stats) && ctx.to.command) {
+        fprintf(stderr,
+                "--read, --write, --batch, --master and --stats cannot be combined with a "
+                "command\n");
+        usage(2);
+    }
+
+    if (ctx.to.detach && (ctx.to.nfileops || ctx.to.batch || ctx.to.master || ctx.to.stats)) {
+        fprintf(stderr,
+                "--detach cannot be combined with --read, --write, --batch, --master or "
+                "--stats\n");
+        usage(2);
+    }
+
+    if (attach != -1) {
+        // Attaching is between us and the session, the daemon has no part in it
+        if (!need_client || attach <= 0) usage(2);
+        return attach_session(attach);
+    }
+
     if (need_client) {
         // attempt to connect to daemon...
-        ALOGD("starting daemon client %d %d", getuid(), geteuid());
-        return connect_daemon(argc, argv, ppid);
+        IF_ALOGD() {
+            ALOGD("starting daemon client %d %d", getuid(), geteuid());
+        }
+        if (ctx.to.master) {
+            return run_master(argc, argv, ppid);
+        }
+        return connect_daemon(argc, argv, ppid, &client_opts);
     }
 
     if (optind < argc && !strcmp(argv[optind], "-")) {
@@ -469,38 +803,86 @@ int su_main(int argc, char* argv[], int need_client) {
     }
     ctx.to.optind = optind;
 
-    if (from_init(&ctx.from) < 0) {
+    // The built-ins run no command, so there is nothing for arguments to go to
+    if (ctx.to.nfileops && optind < argc) {
+        fprintf(stderr, "--read and --write take no further arguments\n");
+        usage(2);
+    }
+
+    trace_begin("from_init", daemon_request_id);
+    int from = from_init(&ctx.from);
+    trace_end();
+    if (from < 0) {
+        decided(&ctx, STATS_DENY_UNKNOWN_CALLER, AUDIT_DENY_UNKNOWN_CALLER);
         deny(&ctx);
     }
 
-    ALOGE("SU from: %s", ctx.from.name);
+    IF_ALOGD() {
+        ALOGD("SU from: %s", ctx.from.name);
+    }
 
     if (ctx.from.uid == AID_ROOT) {
-        ALOGD("Allowing root.");
+        IF_ALOGD() {
+            ALOGD("Allowing root.");
+        }
+        decided(&ctx, STATS_ALLOW_ROOT, AUDIT_ALLOW_ROOT);
         allow(&ctx, NULL);
     }
 
     // check if superuser is disabled completely
-    if (access_disabled(&ctx.from)) {
-        ALOGD("access_disabled");
+    trace_begin("access_disabled", daemon_request_id);
+    int disabled = access_disabled(&ctx.from);
+    trace_end();
+    if (disabled) {
+        IF_ALOGD() {
+            ALOGD("access_disabled");
+        }
+        decided(&ctx, STATS_DENY_ACCESS_DISABLED, AUDIT_DENY_ACCESS_DISABLED);
         deny(&ctx);
     }
 
+    // The master session we were forwarded through went through the allow
+    // chain once, when it was opened, for the same caller and target. Root
+    // access may have been turned off since, which is why this comes after
+    // access_disabled(), but AppOps is not asked again while it lasts.
+    if (daemon_session && ctx.from.uid == daemon_session_from_uid &&
+        ctx.to.uid == daemon_session_to_uid && !ctx.to.master) {
+        IF_ALOGD() {
+            ALOGD("Allowing via master session.");
+        }
+        decided(&ctx, STATS_ALLOW_MASTER, AUDIT_ALLOW_MASTER);
+        allow(&ctx, NULL);
+    }
+
     // autogrant shell at this point
     if (ctx.from.uid == AID_SHELL) {
-        ALOGD("Allowing shell.");
+        IF_ALOGD() {
+            ALOGD("Allowing shell.");
+        }
+        decided(&ctx, STATS_ALLOW_SHELL, AUDIT_ALLOW_SHELL);
         allow(&ctx, NULL);
     }
 
+    trace_begin("resolve_package_name", daemon_request_id);
     char* packageName = resolve_package_name(ctx.from.uid);
+    trace_end();
     if (packageName) {
-        if (!appops_start_op_su(ctx.from.uid, packageName)) {
-            ALOGD("Allowing via appops.");
+        trace_begin("appops_start_op_su", daemon_request_id);
+        int64_t start = stats_now_ns();
+        int denied = appops_start_op_su(ctx.from.uid, packageName);
+        stats_record(STATS_APPOPS, stats_now_ns() - start);
+        trace_end();
+        if (!denied) {
+            IF_ALOGD() {
+                ALOGD("Allowing via appops.");
+            }
+            decided(&ctx, STATS_ALLOW_APPOPS, AUDIT_ALLOW_APPOPS);
             allow(&ctx, packageName);
         }
         free(packageName);
     }
 
     ALOGE("Allow chain exhausted, denying request");
+    decided(&ctx, STATS_DENY_APPOPS, AUDIT_DENY_APPOPS);
     deny(&ctx);
 }
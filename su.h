@@ -19,6 +19,8 @@
 #ifndef SU_h
 #define SU_h 1
 
+#include <stdint.h>
+
 #ifdef LOG_TAG
 #undef LOG_TAG
 #endif
@@ -30,7 +32,10 @@
 #define LINEAGE_ROOT_ACCESS_ADB_ONLY 2
 #define LINEAGE_ROOT_ACCESS_APPS_AND_ADB 3
 
+// The host build of su-bench-e2e puts the daemon elsewhere
+#ifndef DAEMON_SOCKET_PATH
 #define DAEMON_SOCKET_PATH "/dev/socket/su-daemon/"
+#endif
 
 #define DEFAULT_SHELL "/system/bin/sh"
 
@@ -42,7 +47,59 @@
 #endif
 #define VERSION xstr(VERSION_CODE) " cm-su"
 
-#define PROTO_VERSION 1
+/*
+ * A request opens with the version of the protocol it is in. The daemon
+ * acknowledges a request with its own, and hangs up at once on one in any
+ * other version, without reading the rest.
+ */
+#define PROTO_VERSION 2
+
+// Flags of a request, sent along with it
+#define SU_REQUEST_PROFILE 1  // the daemon sends struct su_profile after the exit code
+#define SU_REQUEST_TIME 2     // the daemon sends struct su_exit_info after the exit code
+
+/*
+ * The exit code is followed by struct su_exit_info, then struct su_profile,
+ * each only if the request asked for it. They go out with the exit code
+ * in a single send().
+ */
+
+/*
+ * How the command ended and what it cost, as wait4() told the daemon. It
+ * covers su in the daemon as well as the command, from the fork for the
+ * request on, along with anything the command waited for.
+ */
+struct su_exit_info {
+    int32_t status;       // the exit status, or -1 if a signal ended it
+    int32_t signal;       // the signal which ended it, or 0
+    int32_t core_dumped;  // whether that signal left a core dump
+    int32_t reserved;
+    int64_t wall_ns;      // from the fork to the exit
+    int64_t utime_us;     // user CPU time
+    int64_t stime_us;     // system CPU time
+    int64_t maxrss_kb;    // the largest resident set
+    int64_t nvcsw;        // voluntary context switches
+    int64_t nivcsw;       // involuntary context switches
+};
+
+/*
+ * When the daemon got to each stage of a request, on CLOCK_MONOTONIC in
+ * nanoseconds, or 0 for a stage the request never reached.
+ */
+struct su_profile {
+    int64_t accepted;      // the connection was accepted
+    int64_t acknowledged;  // the request was read and acknowledged
+    int64_t decided;       // the request was allowed or denied
+    int64_t executed;      // the command was about to be executed
+    int64_t exited;        // the command exited
+};
+
+// Abstract socket of the host of a su --detach session, by session ID
+#define SESSION_SOCKET_FORMAT "su-session-%d"
+// Sent by an attached client when its window size changes
+#define SESSION_RESIZE 'W'
+// Typed by the user of an attached client to detach it, Ctrl-backslash
+#define SESSION_DETACH_CHAR 0x1c
 
 struct su_initiator {
     pid_t pid;
@@ -53,6 +110,11 @@ struct su_initiator {
     char args[4096];
 };
 
+struct su_fileop {
+    const char* path;
+    const char* value;  // NULL for a read
+};
+
 struct su_request {
     unsigned uid;
     char name[64];
@@ -63,8 +125,19 @@ struct su_request {
     char** argv;
     int argc;
     int optind;
+    struct su_fileop* fileops;
+    int nfileops;
+    char* batch;
+    int jobs;
+    int master;
+    int detach;
+    int stats;  // one of the SU_STATS_* formats, or 0
 };
 
+// Formats of su --stats
+#define SU_STATS_TEXT 1
+#define SU_STATS_BINARY 2
+
 struct su_context {
     struct su_initiator from;
     struct su_request to;
@@ -88,11 +161,26 @@ static inline char* get_command(const struct su_request* to) {
     return DEFAULT_SHELL;
 }
 
+int run_batch(const struct su_context* ctx);
+
 int appops_start_op_su(int uid, const char* pkgName);
 int appops_finish_op_su(int uid, const char* pkgName);
 
 int run_daemon();
-int connect_daemon(int argc, char* argv[], int ppid);
+// Options which only concern the client side of a request
+struct su_client_options {
+    const char* record;  // file to record the terminal session to, or NULL
+    int low_latency;     // relay the terminal without holding back any output
+    int no_pty;          // pass our stdio to the command as it is
+    int profile;         // print how long each stage of the request took
+    int time;            // print how the command ended and what it cost
+};
+
+int connect_daemon(int argc, char* argv[], int ppid, const struct su_client_options* opts);
+int run_master(int argc, char* argv[], int ppid);
+int run_master_session(int control, unsigned from_uid, unsigned to_uid);
+void detach_session(unsigned from_uid, const char* packageName);
+int attach_session(int id);
 int su_main(int argc, char* argv[], int need_client);
 // for when you give zero fucks about the state of the child process.
 // this version of fork understands you don't care about the child.
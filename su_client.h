@@ -0,0 +1,107 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * su_client.h
+ *
+ * Makes root requests to the su daemon from within the calling process,
+ * without forking and executing the su binary. Requests are authorized
+ * exactly as if the caller had run su itself.
+ *
+ * argv is the full su command line, including argv[0] and terminated by
+ * NULL, e.g. { "su", "-c", "id", NULL }. The request runs with infd, outfd
+ * and errfd as its stdio; any of them may be -1 to leave that stream closed.
+ * No pseudo-terminal is ever allocated.
+ */
+
+#ifndef _SU_CLIENT_H_
+#define _SU_CLIENT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * su_client_start
+ *
+ * Sends a request to the daemon and returns once it has been accepted.
+ * The descriptors have been passed to the daemon by then, so the caller
+ * may close its copies.
+ *
+ * Return Value
+ * on failure, -1 and errno is set
+ * on success, a descriptor which becomes readable when the request has
+ *      finished. It must be handed to su_client_finish().
+ */
+int su_client_start(const char* const argv[], int infd, int outfd, int errfd);
+
+/**
+ * su_client_finish
+ *
+ * Waits for a request started with su_client_start() to finish, and
+ * closes its descriptor.
+ *
+ * Return Value
+ * on failure, -1 and errno is set
+ * on success, the exit code of the request
+ */
+int su_client_finish(int fd);
+
+/**
+ * su_client_exec
+ *
+ * Runs a request to completion, see su_client_start().
+ *
+ * Return Value
+ * on failure, -1 and errno is set
+ * on success, the exit code of the request
+ */
+int su_client_exec(const char* const argv[], int infd, int outfd, int errfd);
+
+#ifdef __cplusplus
+}
+
+#include <future>
+#include <string>
+#include <vector>
+
+namespace su {
+
+/**
+ * Starts a request and returns a future for its exit code, which is -1
+ * if the request could not be made.
+ */
+inline std::future<int> ExecAsync(const std::vector<std::string>& args, int infd, int outfd,
+                                  int errfd) {
+    std::vector<const char*> argv;
+    for (const std::string& arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    int fd = su_client_start(argv.data(), infd, outfd, errfd);
+    if (fd < 0) {
+        std::promise<int> failed;
+        failed.set_value(-1);
+        return failed.get_future();
+    }
+    return std::async(std::launch::async, su_client_finish, fd);
+}
+
+}  // namespace su
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+/*
+** Copyright 2018, The LineageOS Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef SU_TRACE_H
+#define SU_TRACE_H
+
+#include <stdio.h>
+
+#include <cutils/trace.h>
+
+/*
+ * Trace spans for the stages of a request, in the client, the daemon and
+ * the su child serving it. They show up in systrace and Perfetto with the
+ * "adb" category enabled, e.g. atrace adb.
+ *
+ * A span is named "su <stage> <id>", the id being the pid of the client
+ * which made the request, so the spans of one request can be picked out
+ * in every process it goes through.
+ *
+ * With the category disabled a span costs a check of the enabled tags, the
+ * name is only formatted while tracing.
+ */
+
+#define SU_TRACE_TAG ATRACE_TAG_ADB
+
+static inline void trace_begin(const char* stage, int id) {
+    char name[64];
+
+    if (!atrace_is_tag_enabled(SU_TRACE_TAG)) return;
+    snprintf(name, sizeof(name), "su %s %d", stage, id);
+    atrace_begin(SU_TRACE_TAG, name);
+}
+
+// Ends the latest span begun by this thread. Spans do not survive a fork or
+// an exec, end them in the process that began them.
+static inline void trace_end(void) {
+    atrace_end(SU_TRACE_TAG);
+}
+
+#endif
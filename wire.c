@@ -0,0 +1,198 @@
+/*
+** Copyright 2010, Adam Shanks (@ChainsDD)
+** Copyright 2008, Zinx Verituse (@zinxv)
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "su.h"
+#include "wire.h"
+
+/*
+ * Receive a file descriptor from a Unix socket.
+ * Contributed by @mkasick
+ *
+ * Stores the file descriptor in *fd, or -1 if a file
+ * descriptor was not actually included in the message
+ */
+int wire_recv_fd(int sockfd, int* fd) {
+    // Need to receive data from the message, otherwise don't care about it.
+    char iovbuf;
+
+    struct iovec iov = {
+        .iov_base = &iovbuf,
+        .iov_len = 1,
+    };
+
+    char cmsgbuf[CMSG_SPACE(sizeof(int))];
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = cmsgbuf,
+        .msg_controllen = sizeof(cmsgbuf),
+    };
+
+    if (recvmsg(sockfd, &msg, MSG_WAITALL) != 1) {
+        goto error;
+    }
+
+    // Was a control message actually sent?
+    switch (msg.msg_controllen) {
+        case 0:
+            // No, so the file descriptor was closed and won't be used.
+            *fd = -1;
+            return 0;
+        case sizeof(cmsgbuf):
+            // Yes, grab the file descriptor from it.
+            break;
+        default:
+            goto error;
+    }
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+
+    if (cmsg == NULL ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int)) ||
+        cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS) {
+        goto error;
+    }
+
+    *fd = *(int*)CMSG_DATA(cmsg);
+    return 0;
+
+error:
+    ALOGE("unable to read fd");
+    return -1;
+}
+
+/*
+ * Send a file descriptor through a Unix socket.
+ * Contributed by @mkasick
+ *
+ * fd may be -1, in which case the dummy data is sent,
+ * but no control message with the FD is sent.
+ */
+int wire_send_fd(int sockfd, int fd) {
+    // Need to send some data in the message, this will do.
+    struct iovec iov = {
+        .iov_base = "",
+        .iov_len = 1,
+    };
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+    };
+
+    char cmsgbuf[CMSG_SPACE(sizeof(int))];
+
+    if (fd != -1) {
+        // Is the file descriptor actually open?
+        if (fcntl(fd, F_GETFD) == -1) {
+            if (errno != EBADF) {
+                goto error;
+            }
+            // It's closed, don't send a control message or sendmsg will EBADF.
+        } else {
+            // It's open, send the file descriptor in a control message.
+            msg.msg_control = cmsgbuf;
+            msg.msg_controllen = sizeof(cmsgbuf);
+
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            if (!cmsg) {
+                goto error;
+            }
+
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+
+            *(int*)CMSG_DATA(cmsg) = fd;
+        }
+    }
+
+    if (sendmsg(sockfd, &msg, MSG_NOSIGNAL) != 1) {
+        goto error;
+    }
+
+    return 0;
+
+error:
+    PLOGE("unable to send fd");
+    return -1;
+}
+
+int wire_read_int(int fd, int* val) {
+    int len = read(fd, val, sizeof(int));
+    if (len != sizeof(int)) {
+        ALOGE("unable to read int: %d", len);
+        return -1;
+    }
+    return 0;
+}
+
+int wire_write_int(int fd, int val) {
+    int written = send(fd, &val, sizeof(int), MSG_NOSIGNAL);
+    if (written != sizeof(int)) {
+        PLOGE("unable to write int");
+        return -1;
+    }
+    return 0;
+}
+
+int wire_read_string(int fd, char** val) {
+    int len;
+    if (wire_read_int(fd, &len)) {
+        return -1;
+    }
+    if (len > PATH_MAX || len < 0) {
+        ALOGE("invalid string length %d", len);
+        return -1;
+    }
+    *val = malloc(sizeof(char) * (len + 1));
+    if (*val == NULL) {
+        ALOGE("unable to malloc string");
+        return -1;
+    }
+    (*val)[len] = '\0';
+    int amount = read(fd, *val, len);
+    if (amount != len) {
+        ALOGE("unable to read string");
+        free(*val);
+        return -1;
+    }
+    return 0;
+}
+
+int wire_write_string(int fd, const char* val) {
+    int len = strlen(val);
+    if (wire_write_int(fd, len)) {
+        return -1;
+    }
+    int written = send(fd, val, len, MSG_NOSIGNAL);
+    if (written != len) {
+        PLOGE("unable to write string");
+        return -1;
+    }
+    return 0;
+}
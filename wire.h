@@ -0,0 +1,44 @@
+/*
+** Copyright 2010, Adam Shanks (@ChainsDD)
+** Copyright 2008, Zinx Verituse (@zinxv)
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * wire.h
+ *
+ * Encoding of the messages exchanged between the su client and daemon.
+ * None of these terminate the process, so they can be used from the
+ * client library as well as from the daemon.
+ */
+
+#ifndef _WIRE_H_
+#define _WIRE_H_
+
+/* All of these return 0 on success, or -1 on failure. */
+
+/* Stores the received descriptor in *fd, or -1 if the sender had none. */
+int wire_recv_fd(int sockfd, int* fd);
+
+/* fd may be -1 or closed, in which case no descriptor is sent. */
+int wire_send_fd(int sockfd, int fd);
+
+int wire_read_int(int fd, int* val);
+int wire_write_int(int fd, int val);
+
+/* The string is allocated with malloc() and owned by the caller. */
+int wire_read_string(int fd, char** val);
+int wire_write_string(int fd, const char* val);
+
+#endif